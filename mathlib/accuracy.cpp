@@ -0,0 +1,1001 @@
+// Differential accuracy check of the specialized and approximate paths of
+// math.hpp. Every check runs the fast path on random inputs, including
+// denormals and huge magnitudes, and measures the error against a double
+// precision evaluation of the generic templates. The generic float path, or
+// for approximations libm in float, is measured too as the baseline.
+//
+// Errors are in units in the last place of the float result, scaled by the
+// magnitude the rounding errors are proportional to (sum of |a * b| for
+// products, 1 for approximations with an absolute error bound), so that
+// cancellation doesn't dominate. Non-finite results only count when they
+// differ from the generic path. Exits with 1 if any check is over budget.
+//
+//   g++ -std=c++17 -O2 -march=native accuracy.cpp -o accuracy
+//   ./accuracy [--samples N] [--seed S] [--filter text]
+
+#include "math.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+std::mt19937 rng(1);
+long samples = 1000000;
+const char *filter = nullptr;
+bool failed = false;
+
+
+// Spacing of floats around 'x', denormal spacing below FLT_MIN.
+double ulp(double x) {
+    x = fabs(x);
+    if (x < FLT_MIN)
+        return ldexp(1.0, -149);
+    int exponent;
+    frexp(x, &exponent);
+    return ldexp(1.0, exponent - 24);
+}
+
+double uniform(double a, double b) {
+    return std::uniform_real_distribution<double>(a, b)(rng);
+}
+
+enum Kind { Normal, Wide, Denormal, Huge, kindCount };
+
+const char *kindNames[] = { "normal", "wide", "denormal", "huge" };
+
+float sample(Kind kind) {
+    float sign = uniform(0, 1) < 0.5 ? -1.f : 1.f;
+    switch (kind) {
+        case Normal:   return float(uniform(-1, 1));
+        case Wide:     return sign * float(ldexp(uniform(1, 2), int(uniform(-60, 60))));
+        case Denormal: return uniform(0, 1) < 0.5 ? sign * float(ldexp(uniform(1, 2), int(uniform(-149, -127))))
+                                                  : float(uniform(-1, 1));
+        default:       return sign * float(ldexp(uniform(1, 2), int(uniform(60, 127))));
+    }
+}
+
+
+struct Check {
+    std::string name;
+    double budget;
+    long count = 0;
+    long mismatches = 0;
+    double maxFast = 0;
+    double maxGeneric = 0;
+    std::string worst;
+
+    Check(const char *name, double budget) : name(name), budget(budget) { }
+
+    static bool same(float a, float b) {
+        return (isnan(a) && isnan(b)) || a == b;
+    }
+
+    static double error(float value, double ref, double scale) {
+        return fabs(value - ref) / ulp(fmax(fabs(ref), scale));
+    }
+
+    void record(float fast, float generic, double ref, double scale, const std::function<std::string()> &input) {
+        count++;
+        double e = 0;
+        if (!std::isfinite(fast) || !std::isfinite((float)ref)) {
+            // Overflowing in a different order is fine as long as the exact
+            // result or one of its partial sums is outside float range too.
+            bool overflow = !std::isfinite((float)ref) || scale > FLT_MAX;
+            if (same(fast, generic) || (!std::isfinite(fast) && overflow))
+                return;
+            mismatches++;
+            e = INFINITY;
+        } else {
+            e = error(fast, ref, scale);
+            if (std::isfinite(generic))
+                maxGeneric = fmax(maxGeneric, error(generic, ref, scale));
+        }
+        if (e > maxFast) {
+            maxFast = e;
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "got %.9g, expected %.17g (scale %.3g)\n    ", fast, ref, scale);
+            worst = buffer + input();
+        }
+    }
+
+    void report() {
+        bool ok = maxFast <= budget;
+        failed |= !ok;
+        printf("%-26s %9ld %12.3f %12.3f %10.1f  %s\n",
+               name.c_str(), count, maxFast, maxGeneric, budget, ok ? "ok" : "FAIL");
+        if (!worst.empty() && maxFast > 0)
+            printf("    %s\n", worst.c_str());
+        if (mismatches)
+            printf("    %ld non-finite mismatches\n", mismatches);
+    }
+};
+
+bool enabled(const char *name) {
+    return !filter || strstr(name, filter);
+}
+
+std::string format(const float *values, int n) {
+    std::string s = "input";
+    char buffer[32];
+    for (int i = 0; i < n; i++) {
+        snprintf(buffer, sizeof(buffer), " %.9g", values[i]);
+        s += buffer;
+    }
+    return s;
+}
+
+
+// Exposes the generic algorithms that the SIMD specializations replace.
+template<typename L, int D = 4>
+struct Generic : eng::Matrix<D, float, L> {
+    Generic(const eng::Matrix<D, float, L> &m) : eng::Matrix<D, float, L>(m) { }
+    using eng::Matrix<D, float, L>::multiplyScalar;
+    using eng::Matrix<D, float, L>::transformScalar;
+    using eng::Matrix<D, float, L>::gaussJordanInverse;
+};
+
+template<typename L>
+eng::Matrix<4, double> widen(const eng::Matrix<4, float, L> &m) {
+    eng::Matrix<4, double> output;
+    for (int row = 0; row < 4; row++)
+        for (int col = 0; col < 4; col++)
+            output(row, col) = m(row, col);
+    return output;
+}
+
+template<typename L>
+eng::Matrix<4, double> absolute(const eng::Matrix<4, float, L> &m) {
+    eng::Matrix<4, double> output = widen(m);
+    for (int row = 0; row < 4; row++)
+        for (int col = 0; col < 4; col++)
+            output(row, col) = fabs(output(row, col));
+    return output;
+}
+
+template<int D, typename L>
+void randomMatrix(eng::Matrix<D, float, L> &m, Kind kind) {
+    for (int row = 0; row < D; row++)
+        for (int col = 0; col < D; col++)
+            m(row, col) = sample(kind);
+}
+
+template<typename L>
+std::string formatMatrices(const eng::Matrix<4, float, L> &a, const eng::Matrix<4, float, L> &b) {
+    float values[32];
+    for (int i = 0; i < 16; i++) {
+        values[i] = a(i / 4, i % 4);
+        values[16 + i] = b(i / 4, i % 4);
+    }
+    return format(values, 32);
+}
+
+template<typename L>
+void checkMatrixMultiply(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, 4);
+    for (long n = 0; n < samples; n++) {
+        eng::Matrix<4, float, L> a, b;
+        randomMatrix(a, Kind(n % kindCount));
+        randomMatrix(b, Kind(n / kindCount % kindCount));
+        eng::Matrix<4, float, L> fast = a * b;
+        eng::Matrix<4, float, L> generic = Generic<L>(a).multiplyScalar(b);
+        eng::Matrix<4, double> ref = widen(a) * widen(b);
+        eng::Matrix<4, double> scale = absolute(a) * absolute(b);
+        for (int row = 0; row < 4; row++)
+            for (int col = 0; col < 4; col++)
+                check.record(fast(row, col), generic(row, col), ref(row, col), scale(row, col),
+                             [&]() { return formatMatrices(a, b); });
+    }
+    check.report();
+}
+
+template<typename L>
+void checkMatrixVector(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, 4);
+    for (long n = 0; n < samples; n++) {
+        eng::Matrix<4, float, L> a;
+        eng::Vec4f v;
+        randomMatrix(a, Kind(n % kindCount));
+        for (int i = 0; i < 4; i++)
+            v[i] = sample(Kind(n / kindCount % kindCount));
+        eng::Vec4f fast = a * v;
+        eng::Vec4f generic = Generic<L>(a).transformScalar(v);
+        eng::Vec4 vd(v[0], v[1], v[2], v[3]);
+        eng::Vec4 va(fabs(v[0]), fabs(v[1]), fabs(v[2]), fabs(v[3]));
+        eng::Vector<4, double> ref = widen(a) * vd;
+        eng::Vector<4, double> scale = absolute(a) * va;
+        for (int row = 0; row < 4; row++)
+            check.record(fast[row], generic[row], ref[row], scale[row], [&]() {
+                float values[20];
+                for (int i = 0; i < 16; i++)
+                    values[i] = a(i / 4, i % 4);
+                for (int i = 0; i < 4; i++)
+                    values[16 + i] = v[i];
+                return format(values, 20);
+            });
+    }
+    check.report();
+}
+
+// Well conditioned matrices, a rotation times a scale in [0.5, 2] plus
+// small noise, multiplied by 2^k to cover the exponent range. Errors are
+// relative to the largest element of the inverse.
+template<typename L>
+void checkMatrixInverse(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, 64);
+    for (long n = 0; n < samples; n++) {
+        eng::Quaternionf q = eng::Quaternionf(float(uniform(-1, 1)), float(uniform(-1, 1)),
+                                              float(uniform(-1, 1)), float(uniform(-1, 1))).normalize();
+        eng::Matrix4x4<float, L> a = eng::Matrix4x4<float, L>::rotation(q)
+            * eng::Matrix4x4<float, L>::scale(float(uniform(0.5, 2)), float(uniform(0.5, 2)), float(uniform(0.5, 2)));
+        float k = float(ldexp(1.0, int(uniform(-60, 60))));
+        for (int row = 0; row < 4; row++)
+            for (int col = 0; col < 4; col++)
+                a(row, col) = (a(row, col) + (n % 4 == 2 ? float(ldexp(uniform(-1, 1), -130)) : float(uniform(-0.05, 0.05)))) * k;
+        eng::Matrix<4, float, L> fast = a.inverse();
+        eng::Matrix<4, float, L> generic = Generic<L>(a).gaussJordanInverse();
+        eng::Matrix<4, double> ref = widen(a).inverse();
+        double scale = 0;
+        for (int row = 0; row < 4; row++)
+            for (int col = 0; col < 4; col++)
+                scale = fmax(scale, fabs(ref(row, col)));
+        for (int row = 0; row < 4; row++)
+            for (int col = 0; col < 4; col++)
+                check.record(fast(row, col), generic(row, col), ref(row, col), scale,
+                             [&]() { return formatMatrices(a, eng::Matrix<4, float, L>()); });
+    }
+    check.report();
+}
+
+void checkVector4() {
+    Check dot("vec4 dot", 4), length("vec4 length", 4), normalize("vec4 normalize", 4);
+    if (!enabled("vec4"))
+        return;
+    for (long n = 0; n < samples; n++) {
+        eng::Vec4f a, b;
+        for (int i = 0; i < 4; i++) {
+            a[i] = sample(Kind(n % kindCount));
+            b[i] = sample(Kind(n / kindCount % kindCount));
+        }
+        auto input = [&]() {
+            float values[8] = { a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3] };
+            return format(values, 8);
+        };
+        double ref = 0, scale = 0, sq = 0;
+        float genericDot = 0, genericSq = 0;
+        for (int i = 0; i < 4; i++) {
+            ref += (double)a[i] * b[i];
+            scale += fabs((double)a[i] * b[i]);
+            sq += (double)a[i] * a[i];
+            genericDot += a[i] * b[i];
+            genericSq += a[i] * a[i];
+        }
+        float genericLength = sqrtf(genericSq);
+        dot.record(a * b, genericDot, ref, scale, input);
+        // The squared length leaves float range for denormal and huge inputs
+        // in every path, so those only test the dot product.
+        Kind kind = Kind(n % kindCount);
+        if (kind == Denormal || kind == Huge)
+            continue;
+        length.record(a.length(), genericLength, sqrt(sq), 0, input);
+        eng::Vec4f u = a.normalize();
+        for (int i = 0; i < 4; i++)
+            normalize.record(u[i], a[i] * (1 / genericLength), a[i] / sqrt(sq), 1 / sqrt(4.0), input);
+    }
+    dot.report();
+    length.report();
+    normalize.report();
+}
+
+void checkAffine() {
+    if (!enabled("affine mul"))
+        return;
+    Check check("affine mul", 4);
+    for (long n = 0; n < samples; n++) {
+        float va[12], vb[12];
+        for (int i = 0; i < 12; i++) {
+            va[i] = sample(Kind(n % kindCount));
+            vb[i] = sample(Kind(n / kindCount % kindCount));
+        }
+        eng::Affinef a, b;
+        for (int i = 0; i < 12; i++) {
+            a[i / 4][i % 4] = va[i];
+            b[i / 4][i % 4] = vb[i];
+        }
+        eng::Affinef fast = a * b;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                double ref = c == 3 ? a[r][3] : 0, scale = fabs(ref);
+                for (int k = 0; k < 3; k++) {
+                    ref += (double)a[r][k] * b[k][c];
+                    scale += fabs((double)a[r][k] * b[k][c]);
+                }
+                float generic = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c];
+                if (c == 3)
+                    generic += a[r][3];
+                check.record(fast[r][c], generic, ref, scale, [&]() {
+                    float values[24];
+                    memcpy(values, va, sizeof(va));
+                    memcpy(values + 12, vb, sizeof(vb));
+                    return format(values, 24);
+                });
+            }
+        }
+    }
+    check.report();
+}
+
+void checkTransformPoints() {
+    if (!enabled("transformPoints"))
+        return;
+    Check check("transformPoints", 4);
+    const int batch = 1000;
+    eng::Vec3fArray in(batch), out(batch);
+    for (long n = 0; n < samples; n += batch) {
+        eng::Mat4f m;
+        randomMatrix(m, Kind(n / batch % kindCount));
+        for (int i = 0; i < batch; i++) {
+            Kind kind = Kind(i % kindCount);
+            in.set(i, eng::Vec3f(sample(kind), sample(kind), sample(kind)));
+        }
+        eng::transformPoints(m, in, out);
+        for (int i = 0; i < batch; i++) {
+            for (int row = 0; row < 3; row++) {
+                double ref = m(row, 3), scale = fabs(ref);
+                for (int k = 0; k < 3; k++) {
+                    ref += (double)m(row, k) * in[i][k];
+                    scale += fabs((double)m(row, k) * in[i][k]);
+                }
+                float generic = m(row, 0) * in[i][0] + m(row, 1) * in[i][1] + m(row, 2) * in[i][2] + m(row, 3);
+                check.record(out[i][row], generic, ref, scale, [&]() {
+                    float values[19];
+                    for (int k = 0; k < 16; k++)
+                        values[k] = m(k / 4, k % 4);
+                    for (int k = 0; k < 3; k++)
+                        values[16 + k] = in[i][k];
+                    return format(values, 19);
+                });
+            }
+        }
+    }
+    check.report();
+}
+
+// Arguments in the documented range, |x| < 1e4, plus denormals and huge
+// ones past trig::reducible, which fall back to Exact.
+template<typename P>
+void checkSincos(const char *name, const char *batchName, double budget) {
+    Check scalar(name, budget), batch(batchName, budget);
+    if (!enabled(name) && !enabled(batchName))
+        return;
+    const int block = 1000;
+    std::vector<float> x(block), s(block), c(block);
+    for (long n = 0; n < samples; n += block) {
+        for (int i = 0; i < block; i++) {
+            switch (i % 4) {
+                case 0:  x[i] = float(uniform(-4, 4)); break;
+                case 1:  x[i] = float(uniform(-1e4, 1e4)); break;
+                case 2:  x[i] = sample(Denormal); break;
+                default: x[i] = sample(Huge); break;
+            }
+        }
+        eng::trig::sincos(x.data(), s.data(), c.data(), block, P());
+        for (int i = 0; i < block; i++) {
+            float ss = 0, cc = 0;
+            eng::trig::sincos(x[i], ss, cc, P());
+            auto input = [&]() { return format(&x[i], 1); };
+            scalar.record(ss, sinf(x[i]), ::sin((double)x[i]), 1, input);
+            scalar.record(cc, cosf(x[i]), ::cos((double)x[i]), 1, input);
+            batch.record(s[i], sinf(x[i]), ::sin((double)x[i]), 1, input);
+            batch.record(c[i], cosf(x[i]), ::cos((double)x[i]), 1, input);
+        }
+    }
+    scalar.report();
+    batch.report();
+}
+
+void checkBlend(const char *name, bool spherical) {
+    if (!enabled(name))
+        return;
+    Check check(name, 4);
+    const int block = 1000;
+    std::vector<eng::Quaternionf> a(block), b(block), out(block);
+    std::vector<float> t(block);
+    for (long n = 0; n < samples; n += block) {
+        for (int i = 0; i < block; i++) {
+            a[i] = eng::Quaternionf(float(uniform(-1, 1)), float(uniform(-1, 1)),
+                                    float(uniform(-1, 1)), float(uniform(-1, 1))).normalize();
+            b[i] = eng::Quaternionf(float(uniform(-1, 1)), float(uniform(-1, 1)),
+                                    float(uniform(-1, 1)), float(uniform(-1, 1))).normalize();
+            if (i % 8 == 0)
+                b[i] = (a[i] + eng::Quaternionf(0, float(uniform(-1e-3, 1e-3)), 0, 0)).normalize();
+            t[i] = float(uniform(0, 1));
+        }
+        if (spherical)
+            eng::slerp(a.data(), b.data(), t.data(), out.data(), block);
+        else
+            eng::nlerp(a.data(), b.data(), t.data(), out.data(), block);
+        for (int i = 0; i < block; i++) {
+            eng::Quaternion qa(a[i].r, a[i].i, a[i].j, a[i].k), qb(b[i].r, b[i].i, b[i].j, b[i].k);
+            eng::Quaternion ref = spherical ? eng::Quaternion::slerp(qa, qb, t[i]) : eng::Quaternion::nlerp(qa, qb, t[i]);
+            eng::Quaternionf generic = spherical ? eng::Quaternionf::slerp(a[i], b[i], t[i]) : eng::Quaternionf::nlerp(a[i], b[i], t[i]);
+            auto input = [&]() {
+                float values[9] = { a[i].r, a[i].i, a[i].j, a[i].k, b[i].r, b[i].i, b[i].j, b[i].k, t[i] };
+                return format(values, 9);
+            };
+            check.record(out[i].r, generic.r, ref.r, 1, input);
+            check.record(out[i].i, generic.i, ref.i, 1, input);
+            check.record(out[i].j, generic.j, ref.j, 1, input);
+            check.record(out[i].k, generic.k, ref.k, 1, input);
+        }
+    }
+    check.report();
+}
+
+// Bones are random rigid transforms with translations up to 10, weights
+// random and normalized. The generic path is the scalar float kernel.
+//
+// Linear blending rounds each element of the blended matrix m relative to
+// the blend of |bone|, so a position component is scaled by that blend
+// applied to |p| and the translation. Rotations cancel when bones point
+// apart, and normalizing the normal then divides its error by the length
+// of m * n, so normals are scaled by the length of |m| |n| over |m n|.
+// Blended dual quaternions are normalized, which divides their rounding
+// errors by the length of the blended rotation, so positions are scaled by
+// the translations over that length and normals by its inverse.
+template<bool dual>
+void checkSkinning(const char *name, double budget) {
+    if (!enabled(name))
+        return;
+    Check check(name, budget);
+    const int bones = 32, block = 1000;
+    std::vector<eng::Affinef> linear(bones);
+    std::vector<eng::DualQuaternionf> quats(bones);
+    std::vector<eng::Affine> linearRef(bones);
+    std::vector<eng::DualQuaternion> quatsRef(bones);
+    std::vector<int> index(block * 4);
+    std::vector<float> weight(block * 4);
+    std::vector<double> weightRef(block * 4);
+    eng::Vec3fArray p(block), nrm(block), op(block), on(block), gp(block), gn(block);
+    eng::Vec3Array pRef(block), nRef(block), opRef(block), onRef(block);
+    for (long n = 0; n < samples; n += block) {
+        for (int b = 0; b < bones; b++) {
+            eng::Quaternionf q = eng::Quaternionf(float(uniform(-1, 1)), float(uniform(-1, 1)),
+                                                  float(uniform(-1, 1)), float(uniform(-1, 1))).normalize();
+            eng::Vec3f t(float(uniform(-10, 10)), float(uniform(-10, 10)), float(uniform(-10, 10)));
+            eng::Quaternion qd(q.r, q.i, q.j, q.k);
+            eng::Vec3 td(t[0], t[1], t[2]);
+            linear[b] = eng::Affinef::fromTRS(t, q, eng::Vec3f(1, 1, 1));
+            linearRef[b] = eng::Affine::fromTRS(td, qd, eng::Vec3(1, 1, 1));
+            quats[b] = eng::DualQuaternionf::fromRotationTranslation(q, t);
+            quatsRef[b] = eng::DualQuaternion::fromRotationTranslation(qd, td);
+        }
+        for (int i = 0; i < block; i++) {
+            float sum = 0;
+            for (int k = 0; k < 4; k++) {
+                index[i * 4 + k] = int(uniform(0, bones));
+                weight[i * 4 + k] = float(uniform(0, 1));
+                sum += weight[i * 4 + k];
+            }
+            for (int k = 0; k < 4; k++)
+                weightRef[i * 4 + k] = weight[i * 4 + k] /= sum;
+            eng::Vec3f pv(float(uniform(-1, 1)), float(uniform(-1, 1)), float(uniform(-1, 1)));
+            eng::Vec3f nv = eng::Vec3f(float(uniform(-1, 1)), float(uniform(-1, 1)), float(uniform(-1, 1))).normalize();
+            p.set(i, pv);
+            nrm.set(i, nv);
+            pRef.set(i, eng::Vec3(pv[0], pv[1], pv[2]));
+            nRef.set(i, eng::Vec3(nv[0], nv[1], nv[2]));
+        }
+        if (dual) {
+            eng::skinDualQuaternion(quats.data(), index.data(), weight.data(), p, nrm, op, on);
+            eng::stream::skinDualRange(quats.data(), index.data(), weight.data(), p.x(), p.y(), p.z(),
+                                       nrm.x(), nrm.y(), nrm.z(), gp.x(), gp.y(), gp.z(), gn.x(), gn.y(), gn.z(), 0, block);
+            eng::skinDualQuaternion(quatsRef.data(), index.data(), weightRef.data(), pRef, nRef, opRef, onRef);
+        } else {
+            eng::skinLinear(linear.data(), index.data(), weight.data(), p, nrm, op, on);
+            eng::stream::skinLinearRange(linear.data(), index.data(), weight.data(), p.x(), p.y(), p.z(),
+                                         nrm.x(), nrm.y(), nrm.z(), gp.x(), gp.y(), gp.z(), gn.x(), gn.y(), gn.z(), 0, block);
+            eng::skinLinear(linearRef.data(), index.data(), weightRef.data(), pRef, nRef, opRef, onRef);
+        }
+        for (int i = 0; i < block; i++) {
+            auto input = [&]() {
+                float values[24];
+                for (int k = 0; k < 4; k++) {
+                    values[k] = float(index[i * 4 + k]);
+                    values[4 + k] = weight[i * 4 + k];
+                }
+                for (int k = 0; k < 3; k++) {
+                    values[8 + k] = p[i][k];
+                    values[11 + k] = nrm[i][k];
+                }
+                return format(values, 14);
+            };
+            double pScale[3] = { 10, 10, 10 }, nScale = 1;
+            if (dual) {
+                const eng::Quaternion &first = quatsRef[index[i * 4]].real;
+                double blend[4] = { };
+                for (int k = 0; k < 4; k++) {
+                    const eng::Quaternion &q = quatsRef[index[i * 4 + k]].real;
+                    double w = q.dot(first) < 0 ? -weightRef[i * 4 + k] : weightRef[i * 4 + k];
+                    blend[0] += w * q.r;
+                    blend[1] += w * q.i;
+                    blend[2] += w * q.j;
+                    blend[3] += w * q.k;
+                }
+                nScale = 1 / sqrt(blend[0] * blend[0] + blend[1] * blend[1] + blend[2] * blend[2] + blend[3] * blend[3]);
+                for (int k = 0; k < 3; k++)
+                    pScale[k] = 10 * nScale;
+            } else {
+                double m[12] = { }, a[12] = { };
+                for (int k = 0; k < 4; k++) {
+                    double w = weightRef[i * 4 + k];
+                    const double *b = linearRef[index[i * 4 + k]].data();
+                    for (int c = 0; c < 12; c++) {
+                        m[c] += w * b[c];
+                        a[c] += w * fabs(b[c]);
+                    }
+                }
+                eng::Vec3 pv = pRef[i], nv = nRef[i];
+                double rotated = 0, bound = 0;
+                for (int k = 0; k < 3; k++) {
+                    const double *row = m + 4 * k, *abs = a + 4 * k;
+                    pScale[k] = abs[0] * fabs(pv[0]) + abs[1] * fabs(pv[1]) + abs[2] * fabs(pv[2]) + abs[3];
+                    double r = row[0] * nv[0] + row[1] * nv[1] + row[2] * nv[2];
+                    double s = abs[0] * fabs(nv[0]) + abs[1] * fabs(nv[1]) + abs[2] * fabs(nv[2]);
+                    rotated += r * r;
+                    bound += s * s;
+                }
+                nScale = sqrt(bound / rotated);
+            }
+            for (int k = 0; k < 3; k++) {
+                check.record(op[i][k], gp[i][k], opRef[i][k], pScale[k], input);
+                check.record(on[i][k], gn[i][k], onRef[i][k], nScale, input);
+            }
+        }
+    }
+    check.report();
+}
+
+
+// Products from gemm::minimumDimension up go through the blocked kernel.
+// The sizes cover a single tile, ragged edges and more depth than one
+// packed panel. A dot product of D terms is within D units of roundoff of
+// the sum of |a * b|, whatever the order of the additions, so that is the
+// budget.
+template<int D>
+void checkGemm(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, D);
+    std::vector<double> ref(D * D), scale(D * D);
+    // The references take D^3 steps, so past 64 an output counts for D / 64
+    // samples.
+    for (long n = 0, product = 0; n < samples; n += D * D * std::max(1, D / 64), product++) {
+        Kind kind = Kind(product % kindCount);
+        eng::Matrix<D, float> a, b;
+        randomMatrix(a, kind);
+        randomMatrix(b, Kind(product / kindCount % kindCount));
+        eng::Matrix<D, float> fast = a * b;
+        eng::Matrix<D, float> generic = Generic<eng::ColumnMajor, D>(a).multiplyScalar(b);
+        std::fill(ref.begin(), ref.end(), 0.0);
+        std::fill(scale.begin(), scale.end(), 0.0);
+        for (int col = 0; col < D; col++) {
+            for (int k = 0; k < D; k++) {
+                double y = b(k, col);
+                for (int row = 0; row < D; row++) {
+                    ref[col * D + row] += a(row, k) * y;
+                    scale[col * D + row] += fabs(a(row, k) * y);
+                }
+            }
+        }
+        for (int col = 0; col < D; col++) {
+            for (int row = 0; row < D; row++) {
+                check.record(fast(row, col), generic(row, col), ref[col * D + row], scale[col * D + row], [&]() {
+                    char buffer[96];
+                    snprintf(buffer, sizeof(buffer), "element (%d, %d) of a product of %s and %s matrices",
+                             row, col, kindNames[kind], kindNames[product / kindCount % kindCount]);
+                    return std::string(buffer);
+                });
+            }
+        }
+    }
+    check.report();
+}
+
+// Direct DFT, the reference in double and the generic path in float.
+// 'sign' is -1 for the forward transform and 1 for the inverse, which is
+// scaled by 1 / n.
+template<typename T>
+void directDFT(const std::vector<float> &re, const std::vector<float> &im, int sign,
+               std::vector<T> &outR, std::vector<T> &outI) {
+    int n = (int)re.size();
+    std::vector<T> wr(n), wi(n);
+    for (int m = 0; m < n; m++) {
+        wr[m] = T(cos(2 * eng::constant::pi * m / n));
+        wi[m] = T(sign * sin(2 * eng::constant::pi * m / n));
+    }
+    for (int k = 0; k < n; k++) {
+        T sr = 0, si = 0;
+        for (int j = 0, m = 0; j < n; j++, m = m + k < n ? m + k : m + k - n) {
+            sr += re[j] * wr[m] - im[j] * wi[m];
+            si += re[j] * wi[m] + im[j] * wr[m];
+        }
+        outR[k] = sign > 0 ? sr / n : sr;
+        outI[k] = sign > 0 ? si / n : si;
+    }
+}
+
+// Sizes with every radix and with odd and prime factors. Each output sums
+// n terms as large as the inputs, so errors are scaled by the sum of |x|,
+// as products are by the sum of |a * b|. Every intermediate value is a
+// partial sum of the same kind, so a stage adds a few roundings of at most
+// that size, and 16 covers the ten levels of the largest size. Huge inputs
+// only run forward, the inverse overflows its sums before it scales them
+// by 1 / n. The generic path is a direct DFT in float.
+void checkFFT(const char *name, const char *inverseName, double budget) {
+    Check forward(name, budget), inverse(inverseName, budget);
+    if (!enabled(name) && !enabled(inverseName))
+        return;
+    const int sizes[] = { 2, 8, 12, 64, 97, 360, 1000, 1024 };
+    const int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    // The references take n^2 steps, so an output counts for 16 samples.
+    for (long n = 0, t = 0; n < samples; t++) {
+        int size = sizes[t % sizeCount];
+        Kind kind = Kind(t / sizeCount % kindCount);
+        n += 64 * size;
+        std::vector<float> re(size), im(size), fr(size), fi(size), gr(size), gi(size);
+        std::vector<double> rr(size), ri(size);
+        double scale = 0;
+        for (int i = 0; i < size; i++) {
+            re[i] = sample(kind);
+            im[i] = sample(kind);
+            scale += fabs((double)re[i]) + fabs((double)im[i]);
+        }
+        eng::FFTPlanf plan(size);
+        for (int direction = -1; direction <= (kind == Huge ? -1 : 1); direction += 2) {
+            fr = re;
+            fi = im;
+            if (direction < 0)
+                plan.forward(fr.data(), fi.data());
+            else
+                plan.inverse(fr.data(), fi.data());
+            directDFT(re, im, direction, gr, gi);
+            directDFT(re, im, direction, rr, ri);
+            Check &check = direction < 0 ? forward : inverse;
+            double s = direction < 0 ? scale : scale / size;
+            for (int k = 0; k < size; k++) {
+                auto input = [&]() {
+                    char buffer[96];
+                    snprintf(buffer, sizeof(buffer), "output %d of a size %d transform of %s inputs",
+                             k, size, kindNames[kind]);
+                    return std::string(buffer);
+                };
+                check.record(fr[k], gr[k], rr[k], s, input);
+                check.record(fi[k], gi[k], ri[k], s, input);
+            }
+        }
+    }
+    forward.report();
+    inverse.report();
+}
+
+// The ComplexArray kernels against the ComplexNumber operators. Products
+// are scaled like the matrix ones, quotients by |a| / |b| and rotations by
+// |a|. A quotient is within five units, two for each of the dot products
+// of its numerator and denominator and one for the division, so it gets
+// one more. The magnitude based ones square their inputs in every path, so
+// they only get normal and wide values.
+void checkComplex() {
+    Check multiply("complex multiply", 4), conjugate("complex multiplyConjugate", 4);
+    Check divide("complex divide", 5), magnitude("complex magnitude", 4), normalize("complex normalize", 4);
+    Check rotate("complex rotate", 4), rotateBatch("complex rotate batch", 4);
+    if (!enabled("complex"))
+        return;
+    const int block = 1000;
+    eng::ComplexArrayf a(block), b(block), out(block);
+    std::vector<float> angles(block), lengths(block);
+    for (long n = 0; n < samples; n += block) {
+        Kind kind = Kind(n / block % kindCount);
+        bool squares = kind == Normal || kind == Wide;
+        for (int i = 0; i < block; i++) {
+            a.re()[i] = sample(kind);
+            a.im()[i] = sample(kind);
+            b.re()[i] = sample(Kind(i % kindCount));
+            b.im()[i] = sample(Kind(i % kindCount));
+            angles[i] = float(uniform(-4, 4));
+        }
+        auto input = [&](int i) {
+            return [&a, &b, &angles, i]() {
+                float values[5] = { a.re()[i], a.im()[i], b.re()[i], b.im()[i], angles[i] };
+                return format(values, 5);
+            };
+        };
+
+        eng::multiply(a, b, out);
+        for (int i = 0; i < block; i++) {
+            eng::ComplexNumber<float> x(a.re()[i], a.im()[i]), y(b.re()[i], b.im()[i]), g = x * y;
+            double xr = x.r, xi = x.i, yr = y.r, yi = y.i;
+            multiply.record(out.re()[i], g.r, xr * yr - xi * yi, fabs(xr * yr) + fabs(xi * yi), input(i));
+            multiply.record(out.im()[i], g.i, xr * yi + xi * yr, fabs(xr * yi) + fabs(xi * yr), input(i));
+        }
+
+        eng::multiplyConjugate(a, b, out);
+        for (int i = 0; i < block; i++) {
+            eng::ComplexNumber<float> x(a.re()[i], a.im()[i]), y(b.re()[i], -b.im()[i]), g = x * y;
+            double xr = x.r, xi = x.i, yr = y.r, yi = y.i;
+            conjugate.record(out.re()[i], g.r, xr * yr - xi * yi, fabs(xr * yr) + fabs(xi * yi), input(i));
+            conjugate.record(out.im()[i], g.i, xr * yi + xi * yr, fabs(xr * yi) + fabs(xi * yr), input(i));
+        }
+
+        eng::rotate(a, angles[0], out);
+        for (int i = 0; i < block; i++) {
+            eng::ComplexNumber<float> x(a.re()[i], a.im()[i]), g = x * eng::ComplexNumber<float>(cosf(angles[0]), sinf(angles[0]));
+            double c = cos((double)angles[0]), s = sin((double)angles[0]);
+            double length = sqrt((double)x.r * x.r + (double)x.i * x.i);
+            rotate.record(out.re()[i], g.r, x.r * c - x.i * s, length, input(i));
+            rotate.record(out.im()[i], g.i, x.r * s + x.i * c, length, input(i));
+        }
+
+        eng::rotate(a, angles.data(), out);
+        for (int i = 0; i < block; i++) {
+            eng::ComplexNumber<float> x(a.re()[i], a.im()[i]), g = x * eng::ComplexNumber<float>(cosf(angles[i]), sinf(angles[i]));
+            double c = cos((double)angles[i]), s = sin((double)angles[i]);
+            double length = sqrt((double)x.r * x.r + (double)x.i * x.i);
+            rotateBatch.record(out.re()[i], g.r, x.r * c - x.i * s, length, input(i));
+            rotateBatch.record(out.im()[i], g.i, x.r * s + x.i * c, length, input(i));
+        }
+
+        if (!squares)
+            continue;
+        for (int i = 0; i < block; i++) {
+            b.re()[i] = sample(kind);
+            b.im()[i] = sample(kind);
+        }
+
+        eng::divide(a, b, out);
+        for (int i = 0; i < block; i++) {
+            eng::ComplexNumber<float> x(a.re()[i], a.im()[i]), y(b.re()[i], b.im()[i]), g = x / y;
+            double xr = x.r, xi = x.i, yr = y.r, yi = y.i, d = yr * yr + yi * yi;
+            double quotient = sqrt((xr * xr + xi * xi) / d);
+            divide.record(out.re()[i], g.r, (xr * yr + xi * yi) / d, quotient, input(i));
+            divide.record(out.im()[i], g.i, (xi * yr - xr * yi) / d, quotient, input(i));
+        }
+
+        eng::magnitude(a, lengths.data());
+        eng::normalize(a, out);
+        for (int i = 0; i < block; i++) {
+            eng::ComplexNumber<float> x(a.re()[i], a.im()[i]), g = x.normalize();
+            double length = sqrt((double)x.r * x.r + (double)x.i * x.i);
+            magnitude.record(lengths[i], x.length(), length, 0, input(i));
+            normalize.record(out.re()[i], g.r, x.r / length, 1, input(i));
+            normalize.record(out.im()[i], g.i, x.i / length, 1, input(i));
+        }
+    }
+    multiply.report();
+    conjugate.report();
+    divide.report();
+    magnitude.report();
+    normalize.report();
+    rotate.report();
+    rotateBatch.report();
+}
+
+// Bulk conversions have to match the scalar constructors and conversion
+// operators exactly. Packing gets values of every kind plus infinities and
+// NaN, unpacking random bit patterns. The scalar conversion is both the
+// generic path and the reference, so any difference is over budget.
+template<typename S, typename Bits>
+void checkPack(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, 0);
+    const int block = 1000;
+    const float specials[] = { 0.f, -0.f, INFINITY, -INFINITY, NAN, 1.f, -1.f };
+    std::vector<float> in(block), out(block);
+    std::vector<S> packed(block);
+    for (long n = 0; n < samples; n += 2 * block) {
+        for (int i = 0; i < block; i++) {
+            if (i % 50 == 0)
+                in[i] = specials[i / 50 % 7];
+            else
+                in[i] = i % 2 ? float(uniform(-1.5, 1.5)) : sample(Kind(i / 2 % kindCount));
+        }
+        eng::stream::pack(in.data(), packed.data(), block);
+        for (int i = 0; i < block; i++) {
+            S scalar(in[i]);
+            check.record(float(packed[i]), float(scalar), float(scalar), 0, [&]() { return format(&in[i], 1); });
+        }
+
+        for (int i = 0; i < block; i++)
+            packed[i].bits = Bits(rng());
+        eng::stream::unpack(packed.data(), out.data(), block);
+        for (int i = 0; i < block; i++) {
+            float scalar = packed[i];
+            check.record(out[i], scalar, scalar, 0, [&]() {
+                char buffer[32];
+                snprintf(buffer, sizeof(buffer), "bits 0x%x", (unsigned)packed[i].bits);
+                return std::string(buffer);
+            });
+        }
+    }
+    check.report();
+}
+
+// Same for the 10_10_10_2 formats, which hold a whole Vec4f each.
+template<typename S>
+void checkPackedVectors(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, 0);
+    const int block = 1000;
+    std::vector<eng::Vec4f> in(block), out(block);
+    std::vector<S> packed(block);
+    for (long n = 0; n < samples; n += 8 * block) {
+        for (int i = 0; i < block; i++)
+            for (int k = 0; k < 4; k++)
+                in[i][k] = i % 2 ? float(uniform(-1.5, 1.5)) : sample(Kind((i / 2 + k) % kindCount));
+        eng::pack(in.data(), packed.data(), block);
+        for (int i = 0; i < block; i++) {
+            eng::Vec4f fast = packed[i], scalar = S(in[i]);
+            for (int k = 0; k < 4; k++)
+                check.record(fast[k], scalar[k], scalar[k], 0, [&]() { return format(&in[i][0], 4); });
+        }
+
+        for (int i = 0; i < block; i++)
+            packed[i].bits = uint32_t(rng());
+        eng::unpack(packed.data(), out.data(), block);
+        for (int i = 0; i < block; i++) {
+            eng::Vec4f scalar = packed[i];
+            for (int k = 0; k < 4; k++) {
+                check.record(out[i][k], scalar[k], scalar[k], 0, [&]() {
+                    char buffer[32];
+                    snprintf(buffer, sizeof(buffer), "bits 0x%08x", (unsigned)packed[i].bits);
+                    return std::string(buffer);
+                });
+            }
+        }
+    }
+    check.report();
+}
+
+// Batch culling against Frustum::intersects. The SIMD path sums the plane
+// distance in another order, so bounds within rounding of a plane can go
+// either way. What's measured is the margin, the smallest distance plus
+// radius over the planes in double: a decision on its wrong side is off
+// by the margin, in units of the magnitude of the terms of the distance,
+// so those near a plane cost a few ulps and actual mistakes many. A
+// quarter of the bounds are moved onto a random plane.
+template<bool spheres>
+void checkCull(const char *name) {
+    if (!enabled(name))
+        return;
+    Check check(name, 8);
+    const int block = 1000;
+    eng::Vec3fArray centers(block), extents(block);
+    std::vector<float> radii(block);
+    std::vector<int> visible(block);
+    std::vector<char> fastVisible(block);
+    for (long n = 0; n < samples; n += block) {
+        eng::Quaternionf q = eng::Quaternionf(float(uniform(-1, 1)), float(uniform(-1, 1)),
+                                              float(uniform(-1, 1)), float(uniform(-1, 1))).normalize();
+        eng::Mat4f view = eng::Mat4f::rotation(q)
+            * eng::Mat4f::translation(float(uniform(-50, 50)), float(uniform(-50, 50)), float(uniform(-50, 50)));
+        eng::Mat4f proj = eng::Mat4f::GL_Projection(float(uniform(30, 120)), float(uniform(400, 2000)),
+                                                    float(uniform(400, 2000)), 0.1f, float(uniform(10, 200)));
+        eng::Frustumf frustum(proj * view);
+        for (int i = 0; i < block; i++) {
+            eng::Vec3f min(float(uniform(-150, 150)), float(uniform(-150, 150)), float(uniform(-150, 150)));
+            eng::Vec3f size(float(uniform(0, 20)), float(uniform(0, 20)), float(uniform(0, 20)));
+            eng::AABBf box(min, eng::Vec3f(min[0] + size[0], min[1] + size[1], min[2] + size[2]));
+            eng::Vec3f c = box.center(), e = box.extent();
+            float r = float(uniform(0, 10));
+            if (i % 4 == 0) {
+                const eng::Vec4f &p = frustum.planes[int(uniform(0, 6))];
+                float d = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3]
+                        + (spheres ? r : fabsf(p[0]) * e[0] + fabsf(p[1]) * e[1] + fabsf(p[2]) * e[2]);
+                for (int k = 0; k < 3; k++)
+                    c[k] -= d * p[k];
+            }
+            centers.set(i, c);
+            extents.set(i, e);
+            radii[i] = r;
+        }
+        int count = spheres ? eng::cull(frustum, centers, radii.data(), visible.data())
+                            : eng::cull(frustum, centers, extents, visible.data());
+        std::fill(fastVisible.begin(), fastVisible.end(), 0);
+        for (int v = 0; v < count; v++)
+            fastVisible[visible[v]] = 1;
+        for (int i = 0; i < block; i++) {
+            eng::Vec3f c = centers[i], e = extents[i];
+            bool generic = spheres ? frustum.intersects(eng::Spheref(c, radii[i]))
+                                   : frustum.intersects(eng::AABBf(eng::Vec3f(c[0] - e[0], c[1] - e[1], c[2] - e[2]),
+                                                                   eng::Vec3f(c[0] + e[0], c[1] + e[1], c[2] + e[2])));
+            double margin = INFINITY, scale = 0;
+            for (int p = 0; p < 6; p++) {
+                const eng::Vec4f &plane = frustum.planes[p];
+                double radius = spheres ? radii[i] : 0, distance = plane[3], terms = fabs(plane[3]);
+                for (int k = 0; k < 3; k++) {
+                    if (!spheres)
+                        radius += fabs((double)plane[k]) * e[k];
+                    distance += (double)plane[k] * c[k];
+                    terms += fabs((double)plane[k] * c[k]);
+                }
+                distance += radius;
+                terms += radius;
+                margin = fmin(margin, distance);
+                scale = fmax(scale, terms);
+            }
+            // A decision on the right side of the margin counts as exact.
+            auto decided = [&](bool isVisible) { return isVisible == (margin >= 0) ? float(margin) : 0.f; };
+            check.record(decided(fastVisible[i]), decided(generic), float(margin), scale, [&]() {
+                float values[7] = { c[0], c[1], c[2], e[0], e[1], e[2], radii[i] };
+                return format(values, 7);
+            });
+        }
+    }
+    check.report();
+}
+
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samples = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            rng.seed(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--samples N] [--seed S] [--filter text]\n", argv[0]);
+            return 1;
+        }
+    }
+
+#ifdef ENG_MATH_SSE
+    printf("SIMD paths enabled\n");
+#else
+    printf("SIMD paths disabled, checking the generic code against double\n");
+#endif
+    printf("%-26s %9s %12s %12s %10s\n", "check", "samples", "max ulp", "generic", "budget");
+
+    checkMatrixMultiply<eng::ColumnMajor>("mat4 mul");
+    checkMatrixMultiply<eng::RowMajor>("mat4 mul row-major");
+    checkMatrixVector<eng::ColumnMajor>("mat4 mul vec");
+    checkMatrixVector<eng::RowMajor>("mat4 mul vec row-major");
+    checkMatrixInverse<eng::ColumnMajor>("mat4 inverse");
+    checkMatrixInverse<eng::RowMajor>("mat4 inverse row-major");
+    checkVector4();
+    checkAffine();
+    checkTransformPoints();
+    checkSincos<eng::trig::Fast>("sincos fast", "sincos fast batch", 1);
+    checkSincos<eng::trig::Faster>("sincos faster", "sincos faster batch", 840);
+    checkBlend("nlerp batch", false);
+    checkBlend("slerp batch", true);
+    checkSkinning<false>("skin linear", 8);
+    checkSkinning<true>("skin dual quaternion", 12);
+    checkGemm<16>("gemm 16");
+    checkGemm<67>("gemm 67");
+    checkGemm<300>("gemm 300");
+    checkFFT("fft", "fft inverse", 16);
+    checkComplex();
+    checkPack<eng::half, uint16_t>("pack half");
+    checkPack<eng::snorm16, int16_t>("pack snorm16");
+    checkPack<eng::unorm8, uint8_t>("pack unorm8");
+    checkPackedVectors<eng::unorm10_10_10_2>("pack unorm10_10_10_2");
+    checkPackedVectors<eng::snorm10_10_10_2>("pack snorm10_10_10_2");
+    checkCull<false>("cull boxes");
+    checkCull<true>("cull spheres");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+// Build time and query throughput of eng::BVH on the chalet model of
+// vulkan_tut, or on the .obj given as the first argument. Without the file
+// a sphere of similar triangle count stands in. Rays are primary rays of a
+// 1024x768 camera looking at the model, cast in SIMD groups and one at a
+// time, and random rays through its bounds.
+//
+//   g++ -std=c++17 -O2 -march=native -DENG_MATH_THREADS -pthread -I../vulkan_tut bench_bvh.cpp -o bench_bvh
+
+#include "math.hpp"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <chrono>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<eng::Vec3f> vertices;
+std::vector<uint32_t> indices;
+
+
+double seconds(Clock::time_point t1, Clock::time_point t2) {
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+float randomValue(float low, float high) {
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+bool loadObj(const char *path) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path))
+        return false;
+    for (size_t i = 0; i + 2 < attrib.vertices.size(); i += 3)
+        vertices.push_back(eng::Vec3f(attrib.vertices[i], attrib.vertices[i + 1], attrib.vertices[i + 2]));
+    for (const tinyobj::shape_t &shape : shapes)
+        for (const tinyobj::index_t &index : shape.mesh.indices)
+            indices.push_back((uint32_t)index.vertex_index);
+    return true;
+}
+
+// UV sphere of about 500k triangles.
+void makeSphere() {
+    const int rings = 400, segments = 640;
+    for (int r = 0; r <= rings; r++) {
+        float theta = (float)eng::constant::pi * r / rings;
+        for (int s = 0; s < segments; s++) {
+            float phi = 2 * (float)eng::constant::pi * s / segments;
+            vertices.push_back(eng::Vec3f(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+        }
+    }
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            uint32_t a = r * segments + s, b = r * segments + (s + 1) % segments;
+            uint32_t c = a + segments, d = b + segments;
+            uint32_t quad[6] = { a, c, b, b, c, d };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+// Runs 'f' over 'count' queries and prints the throughput.
+template<typename F>
+void report(const char *name, int count, F f) {
+    f();
+    auto t1 = Clock::now();
+    int reps = 0;
+    do {
+        f();
+        reps++;
+    } while (seconds(t1, Clock::now()) < 0.5);
+    double s = seconds(t1, Clock::now()) / reps;
+    printf("%-22s %12.3f Mq/s %10.3f ms\n", name, count / s * 1e-6, s * 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "../vulkan_tut/chalet.obj";
+    if (!loadObj(path)) {
+        printf("%s not found, using a sphere\n", path);
+        makeSphere();
+    }
+    int triangles = (int)(indices.size() / 3);
+    printf("%d vertices, %d triangles\n", (int)vertices.size(), triangles);
+
+    auto t1 = Clock::now();
+    eng::BVH bvh = eng::BVH::fromTriangles(vertices.data(), indices.data(), triangles, 1);
+    auto t2 = Clock::now();
+    printf("build, 1 thread         %10.1f ms, %d nodes\n", seconds(t1, t2) * 1e3, bvh.nodeCount());
+#ifdef ENG_MATH_THREADS
+    t1 = Clock::now();
+    eng::BVH parallel = eng::BVH::fromTriangles(vertices.data(), indices.data(), triangles);
+    t2 = Clock::now();
+    printf("build, %2u threads       %10.1f ms, %d nodes\n", std::thread::hardware_concurrency(),
+           seconds(t1, t2) * 1e3, parallel.nodeCount());
+#endif
+
+    eng::AABBf bounds = bvh.bounds();
+    eng::Vec3f center = bounds.center(), extent = bounds.extent();
+    float radius = sqrtf(extent * extent);
+
+    const int width = 1024, height = 768;
+    std::vector<eng::Rayf> primary, random;
+    eng::Vec3f eye(center[0], center[1] + radius * 0.5f, center[2] + radius * 2);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            eng::Vec3f target(center[0] + (2.f * x / width - 1) * radius,
+                              center[1] + (1 - 2.f * y / height) * radius * height / width, center[2]);
+            primary.push_back(eng::Rayf(eye, eng::Vec3f(target - eye)));
+        }
+    }
+    for (int i = 0; i < width * height; i++) {
+        eng::Vec3f a(randomValue(-1, 1), randomValue(-1, 1), randomValue(-1, 1));
+        eng::Vec3f b(randomValue(-1, 1), randomValue(-1, 1), randomValue(-1, 1));
+        eng::Vec3f origin(center[0] + a[0] * extent[0] * 2, center[1] + a[1] * extent[1] * 2, center[2] + a[2] * extent[2] * 2);
+        eng::Vec3f target(center[0] + b[0] * extent[0], center[1] + b[1] * extent[1], center[2] + b[2] * extent[2]);
+        random.push_back(eng::Rayf(origin, eng::Vec3f(target - origin)));
+    }
+
+    std::vector<eng::RayHit> hits(primary.size());
+    auto castAll = [&](const std::vector<eng::Rayf> &rays) {
+        for (eng::RayHit &hit : hits)
+            hit.t = INFINITY;
+        bvh.raycast(rays.data(), (int)rays.size(), vertices.data(), indices.data(), hits.data());
+    };
+    auto castSingle = [&](const std::vector<eng::Rayf> &rays) {
+        for (size_t i = 0; i < rays.size(); i++) {
+            hits[i].t = INFINITY;
+            bvh.raycast(rays[i], vertices.data(), indices.data(), hits[i]);
+        }
+    };
+
+    int pixels = width * height;
+    report("primary rays, packets", pixels, [&]() { castAll(primary); });
+    int hitCount = 0;
+    for (const eng::RayHit &hit : hits)
+        hitCount += hit.primitive >= 0;
+    printf("%d of %d primary rays hit\n", hitCount, pixels);
+    report("primary rays, single", pixels, [&]() { castSingle(primary); });
+    report("random rays, packets", pixels, [&]() { castAll(random); });
+    report("random rays, single", pixels, [&]() { castSingle(random); });
+
+    const int queries = 100000;
+    std::vector<eng::AABBf> boxes;
+    std::vector<eng::Spheref> spheres;
+    for (int i = 0; i < queries; i++) {
+        eng::Vec3f c(center[0] + randomValue(-1, 1) * extent[0], center[1] + randomValue(-1, 1) * extent[1],
+                     center[2] + randomValue(-1, 1) * extent[2]);
+        eng::Vec3f e(radius * 0.01f, radius * 0.01f, radius * 0.01f);
+        boxes.push_back(eng::AABBf(eng::Vec3f(c - e), eng::Vec3f(c + e)));
+        spheres.push_back(eng::Spheref(c, radius * 0.01f));
+    }
+    long found = 0;
+    report("box queries", queries, [&]() {
+        for (const eng::AABBf &box : boxes)
+            bvh.query(box, [&](int) { found++; });
+    });
+    report("sphere queries", queries, [&]() {
+        for (const eng::Spheref &sphere : spheres)
+            bvh.query(sphere, [&](int) { found++; });
+    });
+
+    // Brute force on a sample of the primary rays, for scale.
+    const int sample = 256;
+    report("primary rays, brute", sample, [&]() {
+        for (int i = 0; i < sample; i++) {
+            const eng::Rayf &ray = primary[i * 2999 % pixels];
+            float t = INFINITY, u, v;
+            for (int k = 0; k < triangles; k++)
+                eng::intersectTriangle(ray, vertices[indices[3 * k]], vertices[indices[3 * k + 1]],
+                                       vertices[indices[3 * k + 2]], t, u, v);
+            found += t < INFINITY;
+        }
+    });
+
+    return found == 12345 ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+// Times 'a + b * s - c' and '(a - b) * c' over arrays of Vector<D, float>.
+// Build it twice to compare fused against per-operator temporaries:
+//
+//   g++ -O2 -march=native bench_expressions.cpp -o unfused
+//   g++ -O2 -march=native -DENG_MATH_EXPRESSIONS bench_expressions.cpp -o fused
+
+#include "math.hpp"
+
+#include <chrono>
+#include <vector>
+
+#include <stdlib.h>
+
+const int count = 4096;
+const int rounds = 200;
+
+template<int D>
+void bench() {
+    std::vector<eng::Vector<D, float>> a(count), b(count), c(count), r(count);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < D; k++) {
+            a[i][k] = rand() / (float)RAND_MAX;
+            b[i][k] = rand() / (float)RAND_MAX;
+            c[i][k] = rand() / (float)RAND_MAX;
+        }
+    }
+
+    float s = 0.5f;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < rounds; n++)
+        for (int i = 0; i < count; i++)
+            r[i] = a[i] + b[i] * s - c[i];
+    auto t2 = std::chrono::steady_clock::now();
+
+    float sum = 0;
+    for (int n = 0; n < rounds; n++)
+        for (int i = 0; i < count; i++)
+            sum += (a[i] - b[i]) * c[i];
+    auto t3 = std::chrono::steady_clock::now();
+
+    double ops = (double)count * rounds;
+    std::cout << "D = " << D
+              << "\tmadd " << std::chrono::duration<double, std::nano>(t2 - t1).count() / ops << " ns"
+              << "\tdot " << std::chrono::duration<double, std::nano>(t3 - t2).count() / ops << " ns"
+              << "\t(" << r[count / 2][0] << ", " << sum << ")\n";
+}
+
+int main(int argc, char *argv[]) {
+
+#ifdef ENG_MATH_EXPRESSIONS
+    std::cout << "fused\n";
+#else
+    std::cout << "unfused\n";
+#endif
+
+    bench<4>();
+    bench<16>();
+    bench<32>();
+    bench<64>();
+
+    return 0;
+}
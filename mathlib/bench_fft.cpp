@@ -0,0 +1,101 @@
+// Times FFTPlan against a direct DFT with a precomputed table of roots, for
+// power-of-two and mixed-radix sizes. GFLOP/s use the usual 5 n log2(n)
+// count for an FFT of size n, also for the DFT.
+//
+//   g++ -std=c++17 -O2 -march=native bench_fft.cpp -o bench_fft
+
+#include "math.hpp"
+
+#include <chrono>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const double minTime = 1e8;
+
+double sink = 0;
+
+
+// Repeats 'f' until the run takes at least minTime nanoseconds.
+template<typename F>
+double time(F f) {
+    f();
+    long reps = 1;
+    double ns = 0;
+    for (;;) {
+        auto t1 = std::chrono::steady_clock::now();
+        for (long r = 0; r < reps; r++)
+            f();
+        auto t2 = std::chrono::steady_clock::now();
+        ns = std::chrono::duration<double, std::nano>(t2 - t1).count();
+        if (ns >= minTime)
+            break;
+        reps *= 2;
+    }
+    return ns / reps;
+}
+
+template<typename T>
+void dft(int n, const T *cosine, const T *sine, const T *re, const T *im, T *outRe, T *outIm) {
+    for (int k = 0; k < n; k++) {
+        T sr = 0, si = 0;
+        for (int j = 0, w = 0; j < n; j++, w = (w + k) % n) {
+            sr += re[j] * cosine[w] + im[j] * sine[w];
+            si += im[j] * cosine[w] - re[j] * sine[w];
+        }
+        outRe[k] = sr;
+        outIm[k] = si;
+    }
+}
+
+template<typename T>
+void bench(const char *type, int n) {
+    std::vector<T> re(n), im(n), outRe(n), outIm(n), cosine(n), sine(n);
+    for (int i = 0; i < n; i++) {
+        re[i] = T(rand() / (double)RAND_MAX * 2 - 1);
+        im[i] = T(rand() / (double)RAND_MAX * 2 - 1);
+        cosine[i] = T(cos(2 * eng::constant::pi * i / n));
+        sine[i] = T(sin(2 * eng::constant::pi * i / n));
+    }
+    double flops = 5.0 * n * log2((double)n);
+
+    double direct = 0;
+    if (n <= 4096) {
+        direct = time([&]() { dft(n, cosine.data(), sine.data(), re.data(), im.data(), outRe.data(), outIm.data()); });
+        sink += outRe[1];
+    }
+
+    eng::FFTPlan<T> plan(n);
+    outRe = re;
+    outIm = im;
+    double fast = time([&]() { plan.forward(outRe.data(), outIm.data()); });
+    sink += outRe[1];
+
+    std::vector<eng::ComplexNumber<T>> values;
+    for (int i = 0; i < n; i++)
+        values.push_back(eng::ComplexNumber<T>(re[i], im[i]));
+    double interleaved = time([&]() { plan.forward(values.data()); });
+    sink += values[1].r;
+
+    if (direct > 0)
+        printf("%-7s %6d %12.0f %8.2f", type, n, direct, flops / direct);
+    else
+        printf("%-7s %6d %12s %8s", type, n, "-", "-");
+    printf(" %12.0f %8.2f %12.0f %8.2f\n", fast, flops / fast, interleaved, flops / interleaved);
+}
+
+template<typename T>
+void benchType(const char *type) {
+    const int sizes[] = { 64, 256, 1024, 4096, 16384, 65536, 1000, 3 * 1024, 4800 };
+    for (int n : sizes)
+        bench<T>(type, n);
+}
+
+int main() {
+    printf("%-7s %6s %21s %21s %21s\n", "", "", "direct DFT", "split", "ComplexNumber");
+    printf("%-7s %6s %12s %8s %12s %8s %12s %8s\n", "type", "n", "ns", "GFLOP/s", "ns", "GFLOP/s", "ns", "GFLOP/s");
+    benchType<float>("float");
+    benchType<double>("double");
+    return sink == 12345 ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+// GFLOP/s of large matrix products, the plain triple loop against the
+// blocked kernel, on one thread and on every core. Threads need
+// ENG_MATH_THREADS, without it both blocked columns match:
+//
+//   g++ -std=c++17 -O2 -march=native -DENG_MATH_THREADS -pthread bench_gemm.cpp -o bench_gemm
+
+#include "math.hpp"
+
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const double minTime = 2e8;
+
+double sink = 0;
+
+
+// Exposes the loop that the blocked product replaces.
+template<int D, typename T>
+struct Naive : eng::Matrix<D, T> {
+    Naive(const eng::Matrix<D, T> &m) : eng::Matrix<D, T>(m) { }
+    using eng::Matrix<D, T>::multiplyScalar;
+};
+
+// Repeats 'f' until the run takes at least minTime nanoseconds.
+template<typename F>
+double gflops(int n, F f) {
+    f();
+    long reps = 1;
+    double ns = 0;
+    for (;;) {
+        auto t1 = std::chrono::steady_clock::now();
+        for (long r = 0; r < reps; r++)
+            f();
+        auto t2 = std::chrono::steady_clock::now();
+        ns = std::chrono::duration<double, std::nano>(t2 - t1).count();
+        if (ns >= minTime)
+            break;
+        reps *= 2;
+    }
+    return 2.0 * n * n * n * reps / ns;
+}
+
+template<int D, typename T>
+void bench(const char *type) {
+    eng::Matrix<D, T> a, b, out;
+    for (int row = 0; row < D; row++) {
+        for (int col = 0; col < D; col++) {
+            a(row, col) = T(rand() / (double)RAND_MAX * 2 - 1);
+            b(row, col) = T(rand() / (double)RAND_MAX * 2 - 1);
+        }
+    }
+
+    double naive = gflops(D, [&]() { out = Naive<D, T>(a).multiplyScalar(b); });
+    sink += out(0, 0);
+    double blocked = gflops(D, [&]() { out = a.multiply(b, 1); });
+    sink += out(0, 0);
+    double parallel = gflops(D, [&]() { out = a * b; });
+    sink += out(0, 0);
+
+    printf("%-7s %4d %12.2f %12.2f %12.2f\n", type, D, naive, blocked, parallel);
+}
+
+template<typename T>
+void benchType(const char *type) {
+    bench<64, T>(type);
+    bench<128, T>(type);
+    bench<256, T>(type);
+    bench<512, T>(type);
+}
+
+int main() {
+    printf("%-7s %4s %12s %12s %12s   (GFLOP/s)\n", "type", "D", "naive", "blocked", "a * b");
+    benchType<float>("float");
+    benchType<double>("double");
+    return sink == 12345 ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+// Compares quaternion rotation and blending against the matrix route,
+// where rotations are kept as Euler angles and built with x/y/zRotation.
+//
+//   g++ -O2 -march=native bench_quaternion.cpp -o bench_quaternion
+
+#include "math.hpp"
+
+#include <chrono>
+#include <vector>
+
+#include <stdlib.h>
+
+const int count = 4096;
+const int rounds = 200;
+
+float randomRange(float range) {
+    return (rand() / (float)RAND_MAX * 2 - 1) * range;
+}
+
+template<typename F>
+double time(F f) {
+    auto t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < rounds; n++)
+        f();
+    auto t2 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t2 - t1).count() / ((double)count * rounds);
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<eng::Vec3f> angles(count), vectors(count);
+    std::vector<eng::Quaternionf> a(count), b(count), out(count);
+    std::vector<eng::Mat4f> matrices(count);
+    std::vector<float> t(count);
+
+    for (int i = 0; i < count; i++) {
+        angles[i] = eng::Vec3f(randomRange(3.f), randomRange(3.f), randomRange(3.f));
+        vectors[i] = eng::Vec3f(randomRange(1.f), randomRange(1.f), randomRange(1.f));
+        a[i] = eng::Quaternionf(angles[i][0], eng::Vec3f(1, 0, 0))
+             * eng::Quaternionf(angles[i][1], eng::Vec3f(0, 1, 0))
+             * eng::Quaternionf(angles[i][2], eng::Vec3f(0, 0, 1));
+        b[i] = eng::Quaternionf(randomRange(3.f), eng::Vec3f(0, 1, 0));
+        t[i] = randomRange(0.5f) + 0.5f;
+    }
+
+    float sink = 0;
+
+    double quatRotate = time([&]() {
+        for (int i = 0; i < count; i++)
+            sink += a[i].rotate(vectors[i])[0];
+    });
+
+    double quatMatrix = time([&]() {
+        for (int i = 0; i < count; i++) {
+            const eng::Vec3f &v = vectors[i];
+            sink += (eng::Mat4f::rotation(a[i]) * eng::Vec4f(v[0], v[1], v[2], 0))[0];
+        }
+    });
+
+    double eulerMatrix = time([&]() {
+        for (int i = 0; i < count; i++) {
+            const eng::Vec3f &e = angles[i], &v = vectors[i];
+            eng::Mat4f m = eng::Mat4f::xRotation(e[0]) * eng::Mat4f::yRotation(e[1]) * eng::Mat4f::zRotation(e[2]);
+            sink += (m * eng::Vec4f(v[0], v[1], v[2], 0))[0];
+        }
+    });
+
+    double slerpScalar = time([&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = eng::Quaternionf::slerp(a[i], b[i], t[i]);
+    });
+
+    double slerpBatch = time([&]() {
+        eng::slerp(a.data(), b.data(), t.data(), out.data(), count);
+    });
+
+    double nlerpBatch = time([&]() {
+        eng::nlerp(a.data(), b.data(), t.data(), out.data(), count);
+    });
+
+    double nlerpMatrix = time([&]() {
+        eng::nlerp(a.data(), b.data(), t.data(), out.data(), count);
+        for (int i = 0; i < count; i++)
+            matrices[i] = eng::Mat4f::rotation(out[i]);
+    });
+
+    double eulerBlend = time([&]() {
+        for (int i = 0; i < count; i++) {
+            eng::Vec3f e = angles[i] * (1 - t[i]);
+            matrices[i] = eng::Mat4f::xRotation(e[0]) * eng::Mat4f::yRotation(e[1]) * eng::Mat4f::zRotation(e[2]);
+        }
+    });
+
+    std::cout << "rotate vector, ns per vector\n"
+              << "\tquaternion rotate " << quatRotate << "\n"
+              << "\tquaternion matrix " << quatMatrix << "\n"
+              << "\teuler matrices " << eulerMatrix << "\n"
+              << "blend, ns per pair\n"
+              << "\tslerp scalar " << slerpScalar << "\n"
+              << "\tslerp batch " << slerpBatch << "\n"
+              << "\tnlerp batch " << nlerpBatch << "\n"
+              << "\tnlerp batch + matrix " << nlerpMatrix << "\n"
+              << "\teuler lerp + matrices " << eulerBlend << "\n"
+              << "(" << sink << ", " << out[count / 2].r << ", " << matrices[count / 2][0][0] << ")\n";
+
+    return 0;
+}
@@ -0,0 +1,672 @@
+// Micro-benchmarks for the arithmetic of math.hpp, for float and double and
+// D = 2..4 plus larger D. Prints ns/op and throughput, '--json <file>' also
+// writes the results as JSON ('-' for stdout), '--filter <text>' only runs
+// operations whose name contains the text. Build with and without SIMD to
+// compare the specialized paths against the generic ones:
+//
+//   g++ -std=c++17 -O2 -march=native benchmark.cpp -o benchmark
+//   g++ -std=c++17 -O2 -march=native -DENG_MATH_NO_SIMD benchmark.cpp -o benchmark_scalar
+//
+// glm equivalents are timed as well when <glm/glm.hpp> is on the include
+// path, as it is for vulkan_tut.
+
+#include "math.hpp"
+
+#if __has_include(<glm/glm.hpp>)
+    #define BENCH_GLM
+    #include <glm/glm.hpp>
+    #include <glm/gtc/quaternion.hpp>
+#endif
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int count = 1024;
+const double minTime = 2e7;
+
+struct Result {
+    std::string library;
+    std::string op;
+    std::string type;
+    int dims;
+    double ns;
+};
+
+std::vector<Result> results;
+const char *filter = nullptr;
+FILE *table = stdout;
+double sink = 0;
+
+
+template<typename T> const char *typeName();
+template<> const char *typeName<float>() { return "float"; }
+template<> const char *typeName<double>() { return "double"; }
+
+template<typename T>
+T randomValue() {
+    return T(rand() / (double)RAND_MAX * 2 - 1);
+}
+
+// Keeps the compiler from merging repeated runs over the same data.
+inline void clobber() {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif
+}
+
+// 'f' performs 'ops' operations per call, it is repeated until the run
+// takes at least minTime nanoseconds.
+template<typename F>
+void measure(const char *library, const char *op, const char *type, int dims, int ops, F f) {
+    if (filter && !strstr(op, filter))
+        return;
+
+    f();
+    long reps = 1;
+    double ns = 0;
+    for (;;) {
+        auto t1 = std::chrono::steady_clock::now();
+        for (long r = 0; r < reps; r++) {
+            f();
+            clobber();
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        ns = std::chrono::duration<double, std::nano>(t2 - t1).count();
+        if (ns >= minTime)
+            break;
+        reps *= 2;
+    }
+
+    Result result = { library, op, type, dims, ns / ((double)reps * ops) };
+    results.push_back(result);
+    fprintf(table, "%-5s %-16s %-7s %3d %12.3f ns %12.2f Mop/s\n",
+            library, op, type, dims, result.ns, 1e3 / result.ns);
+}
+
+
+template<int D, typename T>
+void benchVector() {
+    std::vector<eng::Vector<D, T>> a(count), b(count), out(count);
+    std::vector<T> s(count);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < D; k++) {
+            a[i][k] = randomValue<T>();
+            b[i][k] = randomValue<T>();
+        }
+    }
+    const char *t = typeName<T>();
+
+    measure("eng", "vec add", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] + b[i];
+    });
+    measure("eng", "vec sub", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] - b[i];
+    });
+    measure("eng", "vec scale", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * T(0.5);
+    });
+    measure("eng", "vec dot", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            s[i] = a[i] * b[i];
+    });
+    measure("eng", "vec length", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            s[i] = a[i].length();
+    });
+    measure("eng", "vec normalize", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i].normalize();
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i][0] + s[i];
+}
+
+template<typename T>
+void benchCross() {
+    std::vector<eng::Vector3<T>> a(count), b(count), out(count);
+    for (int i = 0; i < count; i++)
+        for (int k = 0; k < 3; k++)
+            a[i][k] = randomValue<T>(), b[i][k] = randomValue<T>();
+
+    measure("eng", "vec cross", typeName<T>(), 3, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i].cross(b[i]);
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i][0];
+}
+
+// Diagonally dominant, so that inverses stay well conditioned.
+template<int D, typename T>
+void benchMatrix() {
+    const int n = D > 8 ? 64 : count;
+    std::vector<eng::Matrix<D, T>> a(n), b(n), out(n);
+    std::vector<eng::Vector<D, T>> v(n), vout(n);
+    std::vector<T> s(n);
+    for (int i = 0; i < n; i++) {
+        for (int row = 0; row < D; row++) {
+            v[i][row] = randomValue<T>();
+            for (int col = 0; col < D; col++) {
+                a[i](row, col) = randomValue<T>() + (row == col ? D : 0);
+                b[i](row, col) = randomValue<T>();
+            }
+        }
+    }
+    const char *t = typeName<T>();
+
+    measure("eng", "mat mul", t, D, n, [&]() {
+        for (int i = 0; i < n; i++)
+            out[i] = a[i] * b[i];
+    });
+    measure("eng", "mat mul vec", t, D, n, [&]() {
+        for (int i = 0; i < n; i++)
+            vout[i] = a[i] * v[i];
+    });
+    measure("eng", "mat transpose", t, D, n, [&]() {
+        for (int i = 0; i < n; i++)
+            out[i] = a[i].transpose();
+    });
+    measure("eng", "mat determinant", t, D, n, [&]() {
+        for (int i = 0; i < n; i++)
+            s[i] = a[i].determinant();
+    });
+    measure("eng", "mat inverse", t, D, n, [&]() {
+        for (int i = 0; i < n; i++)
+            out[i] = a[i].inverse();
+    });
+
+    for (int i = 0; i < n; i++)
+        sink += out[i][0][0] + vout[i][0] + s[i];
+}
+
+template<typename T>
+void benchAffine() {
+    std::vector<eng::Matrix4x4<T>> m(count);
+    std::vector<eng::Affine3x4<T>> a(count), b(count), out(count);
+    std::vector<eng::Matrix<3, T>> normals(count);
+    for (int i = 0; i < count; i++) {
+        eng::QuaternionNumber<T> q(randomValue<T>(), randomValue<T>(), randomValue<T>(), randomValue<T>());
+        eng::Vector<3, T> t(randomValue<T>(), randomValue<T>(), randomValue<T>());
+        a[i] = eng::Affine3x4<T>::fromTRS(t, q.normalize(), eng::Vector<3, T>(1, 2, 3));
+        b[i] = eng::Affine3x4<T>::fromTRS(t, q.conjugate().normalize(), eng::Vector<3, T>(1, 1, 1));
+        m[i] = a[i].toMatrix();
+    }
+    const char *t = typeName<T>();
+
+    measure("eng", "affine mul", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * b[i];
+    });
+    measure("eng", "affine inverse", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i].inverse();
+    });
+    measure("eng", "mat affineInverse", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            m[i] = m[i].affineInverse();
+    });
+    measure("eng", "mat normalMatrix", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            normals[i] = m[i].normalMatrix();
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i][0][0] + m[i][0][0] + normals[i][0][0];
+}
+
+template<typename T>
+void benchComplex() {
+    std::vector<eng::ComplexNumber<T>> a, b, out;
+    std::vector<T> s(count);
+    for (int i = 0; i < count; i++) {
+        a.push_back(eng::ComplexNumber<T>(randomValue<T>(), randomValue<T>()));
+        b.push_back(eng::ComplexNumber<T>(randomValue<T>() + 2, randomValue<T>()));
+        out.push_back(a.back());
+    }
+    const char *t = typeName<T>();
+
+    measure("eng", "complex add", t, 2, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] + b[i];
+    });
+    measure("eng", "complex mul", t, 2, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * b[i];
+    });
+    measure("eng", "complex div", t, 2, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] / b[i];
+    });
+    measure("eng", "complex div T", t, 2, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] / b[i].r;
+    });
+    measure("eng", "complex length", t, 2, count, [&]() {
+        for (int i = 0; i < count; i++)
+            s[i] = a[i].length();
+    });
+
+    eng::ComplexArray<T> arrayA(count), arrayB(count), arrayOut(count);
+    std::vector<T> angles(count);
+    for (int i = 0; i < count; i++) {
+        arrayA.set(i, a[i]);
+        arrayB.set(i, b[i]);
+        angles[i] = randomValue<T>() * 3;
+    }
+
+    measure("eng", "carray mul", t, 2, count, [&]() {
+        eng::multiply(arrayA, arrayB, arrayOut);
+    });
+    measure("eng", "carray conj mul", t, 2, count, [&]() {
+        eng::multiplyConjugate(arrayA, arrayB, arrayOut);
+    });
+    measure("eng", "carray div", t, 2, count, [&]() {
+        eng::divide(arrayA, arrayB, arrayOut);
+    });
+    measure("eng", "carray length", t, 2, count, [&]() {
+        eng::magnitude(arrayA, s.data());
+    });
+    measure("eng", "carray normalize", t, 2, count, [&]() {
+        eng::normalize(arrayA, arrayOut);
+    });
+    measure("eng", "carray rotate", t, 2, count, [&]() {
+        eng::rotate(arrayA, T(0.5), arrayOut);
+    });
+    measure("eng", "carray rotate[i]", t, 2, count, [&]() {
+        eng::rotate(arrayA, angles.data(), arrayOut);
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i].r + s[i] + arrayOut.re()[i];
+}
+
+// Bulk conversions to and from the compact storage types. The scalar
+// rows convert one element at a time through the constructors.
+void benchPack() {
+    std::vector<float> in(4 * count), out(4 * count);
+    for (float &f : in)
+        f = randomValue<float>();
+    std::vector<eng::half> h(count);
+    std::vector<eng::snorm16> s16(count);
+    std::vector<eng::unorm8> u8(count);
+    std::vector<eng::snorm10_10_10_2> s10(count);
+
+    measure("eng", "half pack", "float", 1, count, [&]() {
+        eng::stream::pack(in.data(), h.data(), count);
+    });
+    measure("eng", "half pack scalar", "float", 1, count, [&]() {
+        for (int i = 0; i < count; i++)
+            h[i] = eng::half(in[i]);
+    });
+    measure("eng", "half unpack", "float", 1, count, [&]() {
+        eng::stream::unpack(h.data(), out.data(), count);
+    });
+    measure("eng", "half unpk scalar", "float", 1, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = h[i];
+    });
+    measure("eng", "snorm16 pack", "float", 1, count, [&]() {
+        eng::stream::pack(in.data(), s16.data(), count);
+    });
+    measure("eng", "snorm16 unpack", "float", 1, count, [&]() {
+        eng::stream::unpack(s16.data(), out.data(), count);
+    });
+    measure("eng", "unorm8 pack", "float", 1, count, [&]() {
+        eng::stream::pack(in.data(), u8.data(), count);
+    });
+    measure("eng", "unorm8 unpack", "float", 1, count, [&]() {
+        eng::stream::unpack(u8.data(), out.data(), count);
+    });
+    measure("eng", "snorm10 pack", "float", 4, count, [&]() {
+        eng::stream::pack(in.data(), s10.data(), count);
+    });
+    measure("eng", "snorm10 unpack", "float", 4, count, [&]() {
+        eng::stream::unpack(s10.data(), out.data(), count);
+    });
+
+    sink += out[0] + float(h[1]) + float(s16[2]) + float(u8[3]) + s10[4].bits;
+}
+
+// Frustum culling of 'count' boxes and spheres spread around the camera,
+// the scalar row tests one eng::AABB at a time.
+template<typename T>
+void benchCull() {
+    eng::Matrix4x4<T> projView = eng::Matrix4x4<T>::GL_Projection(T(90), T(16), T(9), T(0.1), T(100))
+        * eng::Matrix4x4<T>::translation(T(0), T(0), T(-10));
+    eng::Frustum<T> frustum(projView);
+    eng::Vector3Array<T> centers(count), extents(count);
+    std::vector<T> radii(count);
+    std::vector<eng::AABB<T>> boxes(count);
+    std::vector<int> visible(count);
+    for (int i = 0; i < count; i++) {
+        eng::Vector3<T> c(randomValue<T>() * 50, randomValue<T>() * 50, randomValue<T>() * 50);
+        eng::Vector3<T> e(randomValue<T>() + 1, randomValue<T>() + 1, randomValue<T>() + 1);
+        centers.set(i, c);
+        extents.set(i, e);
+        radii[i] = randomValue<T>() + 1;
+        boxes[i] = eng::AABB<T>(c - e, c + e);
+    }
+    const char *t = typeName<T>();
+    int n = 0;
+
+    measure("eng", "cull boxes", t, 3, count, [&]() {
+        n += eng::cull(frustum, centers, extents, visible.data());
+    });
+    measure("eng", "cull boxes 1x1", t, 3, count, [&]() {
+        int k = 0;
+        for (int i = 0; i < count; i++)
+            if (frustum.intersects(boxes[i]))
+                visible[k++] = i;
+        n += k;
+    });
+    measure("eng", "cull spheres", t, 3, count, [&]() {
+        n += eng::cull(frustum, centers, radii.data(), visible.data());
+    });
+
+    sink += n + visible[0];
+}
+
+template<typename T>
+void benchQuaternion() {
+    std::vector<eng::QuaternionNumber<T>> a(count), b(count), out(count);
+    std::vector<eng::Vector3<T>> v(count), vout(count);
+    std::vector<eng::Matrix4x4<T>> m(count);
+    std::vector<T> w(count);
+    for (int i = 0; i < count; i++) {
+        a[i] = eng::QuaternionNumber<T>(randomValue<T>(), randomValue<T>(), randomValue<T>(), randomValue<T>()).normalize();
+        b[i] = eng::QuaternionNumber<T>(randomValue<T>(), randomValue<T>(), randomValue<T>(), randomValue<T>()).normalize();
+        v[i] = eng::Vector3<T>(randomValue<T>(), randomValue<T>(), randomValue<T>());
+        w[i] = randomValue<T>() * T(0.5) + T(0.5);
+    }
+    const char *t = typeName<T>();
+
+    measure("eng", "quat mul", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * b[i];
+    });
+    measure("eng", "quat normalize", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i].normalize();
+    });
+    measure("eng", "quat inverse", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i].inverse();
+    });
+    measure("eng", "quat rotate", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            vout[i] = a[i].rotate(v[i]);
+    });
+    measure("eng", "quat to matrix", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            m[i] = eng::Matrix4x4<T>::rotation(a[i]);
+    });
+    measure("eng", "quat slerp", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = eng::QuaternionNumber<T>::slerp(a[i], b[i], w[i]);
+    });
+    measure("eng", "quat slerp batch", t, 4, count, [&]() {
+        eng::slerp(a.data(), b.data(), w.data(), out.data(), count);
+    });
+    measure("eng", "quat nlerp batch", t, 4, count, [&]() {
+        eng::nlerp(a.data(), b.data(), w.data(), out.data(), count);
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i].r + vout[i][0] + m[i][0][0];
+}
+
+template<typename T>
+void benchTrig() {
+    std::vector<T> x(count), s(count), c(count);
+    for (int i = 0; i < count; i++)
+        x[i] = randomValue<T>() * 10;
+    const char *t = typeName<T>();
+
+    measure("eng", "sincos exact", t, 1, count, [&]() {
+        for (int i = 0; i < count; i++)
+            eng::trig::sincos(x[i], s[i], c[i]);
+    });
+    measure("eng", "sincos fast", t, 1, count, [&]() {
+        for (int i = 0; i < count; i++)
+            eng::trig::sincos(x[i], s[i], c[i], eng::trig::Fast());
+    });
+    measure("eng", "sincos faster", t, 1, count, [&]() {
+        for (int i = 0; i < count; i++)
+            eng::trig::sincos(x[i], s[i], c[i], eng::trig::Faster());
+    });
+    measure("eng", "sincos batch", t, 1, count, [&]() {
+        eng::trig::sincos(x.data(), s.data(), c.data(), count, eng::trig::Fast());
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += s[i] + c[i];
+}
+
+
+#ifdef BENCH_GLM
+
+template<int D, typename T>
+void benchGlmVector() {
+    typedef glm::vec<D, T, glm::defaultp> V;
+    std::vector<V> a(count), b(count), out(count);
+    std::vector<T> s(count);
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < D; k++) {
+            a[i][k] = randomValue<T>();
+            b[i][k] = randomValue<T>();
+        }
+    }
+    const char *t = typeName<T>();
+
+    measure("glm", "vec add", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] + b[i];
+    });
+    measure("glm", "vec sub", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] - b[i];
+    });
+    measure("glm", "vec scale", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * T(0.5);
+    });
+    measure("glm", "vec dot", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            s[i] = glm::dot(a[i], b[i]);
+    });
+    measure("glm", "vec length", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            s[i] = glm::length(a[i]);
+    });
+    measure("glm", "vec normalize", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = glm::normalize(a[i]);
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i][0] + s[i];
+}
+
+template<int D, typename T>
+void benchGlmMatrix() {
+    typedef glm::mat<D, D, T, glm::defaultp> M;
+    typedef glm::vec<D, T, glm::defaultp> V;
+    std::vector<M> a(count), b(count), out(count);
+    std::vector<V> v(count), vout(count);
+    std::vector<T> s(count);
+    for (int i = 0; i < count; i++) {
+        for (int col = 0; col < D; col++) {
+            v[i][col] = randomValue<T>();
+            for (int row = 0; row < D; row++) {
+                a[i][col][row] = randomValue<T>() + (row == col ? D : 0);
+                b[i][col][row] = randomValue<T>();
+            }
+        }
+    }
+    const char *t = typeName<T>();
+
+    measure("glm", "mat mul", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * b[i];
+    });
+    measure("glm", "mat mul vec", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            vout[i] = a[i] * v[i];
+    });
+    measure("glm", "mat transpose", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = glm::transpose(a[i]);
+    });
+    measure("glm", "mat determinant", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            s[i] = glm::determinant(a[i]);
+    });
+    measure("glm", "mat inverse", t, D, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = glm::inverse(a[i]);
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i][0][0] + vout[i][0] + s[i];
+}
+
+template<typename T>
+void benchGlmQuaternion() {
+    typedef typename std::conditional<std::is_same<T, float>::value, glm::quat, glm::dquat>::type Q;
+    typedef glm::vec<3, T, glm::defaultp> V;
+    std::vector<Q> a(count), b(count), out(count);
+    std::vector<V> v(count), vout(count);
+    std::vector<glm::mat<4, 4, T, glm::defaultp>> m(count);
+    std::vector<T> w(count);
+    for (int i = 0; i < count; i++) {
+        a[i] = glm::normalize(Q(randomValue<T>(), randomValue<T>(), randomValue<T>(), randomValue<T>()));
+        b[i] = glm::normalize(Q(randomValue<T>(), randomValue<T>(), randomValue<T>(), randomValue<T>()));
+        v[i] = V(randomValue<T>(), randomValue<T>(), randomValue<T>());
+        w[i] = randomValue<T>() * T(0.5) + T(0.5);
+    }
+    const char *t = typeName<T>();
+
+    measure("glm", "quat mul", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = a[i] * b[i];
+    });
+    measure("glm", "quat normalize", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = glm::normalize(a[i]);
+    });
+    measure("glm", "quat inverse", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = glm::inverse(a[i]);
+    });
+    measure("glm", "quat rotate", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            vout[i] = a[i] * v[i];
+    });
+    measure("glm", "quat to matrix", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            m[i] = glm::mat4_cast(a[i]);
+    });
+    measure("glm", "quat slerp", t, 4, count, [&]() {
+        for (int i = 0; i < count; i++)
+            out[i] = glm::slerp(a[i], b[i], w[i]);
+    });
+
+    for (int i = 0; i < count; i++)
+        sink += out[i].w + vout[i][0] + m[i][0][0];
+}
+
+#endif
+
+
+template<typename T>
+void benchType() {
+    benchVector<2, T>();
+    benchVector<3, T>();
+    benchVector<4, T>();
+    benchVector<16, T>();
+    benchVector<64, T>();
+    benchCross<T>();
+    benchMatrix<2, T>();
+    benchMatrix<3, T>();
+    benchMatrix<4, T>();
+    benchMatrix<8, T>();
+    benchMatrix<16, T>();
+    benchMatrix<32, T>();
+    benchAffine<T>();
+    benchCull<T>();
+    benchComplex<T>();
+    benchQuaternion<T>();
+    benchTrig<T>();
+
+#ifdef BENCH_GLM
+    benchGlmVector<2, T>();
+    benchGlmVector<3, T>();
+    benchGlmVector<4, T>();
+    benchGlmMatrix<2, T>();
+    benchGlmMatrix<3, T>();
+    benchGlmMatrix<4, T>();
+    benchGlmQuaternion<T>();
+#endif
+}
+
+void writeJson(FILE *file) {
+#ifdef ENG_MATH_SSE
+    const char *simd = "true";
+#else
+    const char *simd = "false";
+#endif
+    fprintf(file, "{\n  \"simd\": %s,\n  \"results\": [\n", simd);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(file, "    { \"library\": \"%s\", \"op\": \"%s\", \"type\": \"%s\", \"dims\": %d, "
+                      "\"ns_per_op\": %.4f, \"mops_per_s\": %.4f }%s\n",
+                r.library.c_str(), r.op.c_str(), r.type.c_str(), r.dims,
+                r.ns, 1e3 / r.ns, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *jsonPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            jsonPath = argv[++i];
+            if (!strcmp(jsonPath, "-"))
+                table = stderr;
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--json <file>|-] [--filter <text>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    srand(1);
+    benchType<float>();
+    benchType<double>();
+    benchPack();
+
+    if (jsonPath) {
+        FILE *file = strcmp(jsonPath, "-") ? fopen(jsonPath, "w") : stdout;
+        if (!file) {
+            fprintf(stderr, "could not open %s\n", jsonPath);
+            return 1;
+        }
+        writeJson(file);
+        if (file != stdout)
+            fclose(file);
+    }
+
+    fprintf(stderr, "(%g)\n", sink);
+    return 0;
+}
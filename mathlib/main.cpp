@@ -57,5 +57,13 @@ int main(int argc, char *argv[]) {
     std::cout << (quat1 * num5) << '\n';
     std::cout << (quat1 * 4) << '\n';
 
+    eng::ComplexArray<double> phasors(4);
+    for (int i = 0; i < phasors.size(); i++)
+        phasors.set(i, eng::Complex(i + 1, 0));
+    eng::rotate(phasors, eng::constant::pi / 2, phasors);
+    std::cout << phasors[2] << '\n';
+    eng::multiply(phasors, phasors, phasors);
+    std::cout << phasors[2] << '\n';
+
     return 0;
 }
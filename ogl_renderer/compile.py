@@ -19,7 +19,7 @@ additional_objects  = [ ]
 libraries = [ "GL", "GLU", "glfw3", "X11", "Xxf86vm", 
               "Xrandr", "pthread", "Xi", "dl", "Xinerama", "Xcursor" ]
 defines   = [ ]
-flags     = [ "-Wall" ]
+flags     = [ "-std=c++17", "-Wall", "-O2", "-march=native" ]
 
 
 def endswith_lst(input_str, ends):
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+// Shadows the GL state that main.cpp sets and drops calls that wouldn't
+// change it. Everything bound through here has to stay bound through here,
+// after direct GL calls that touch the same state call invalidate().
+class GLState {
+
+public:
+
+    struct Counters {
+        int issued = 0;
+        int skipped = 0;
+    };
+
+    GLState() { invalidate(); }
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    // Go to the current program, values are remembered per program.
+    void uniform1i(GLint location, GLint value);
+    void uniform1f(GLint location, GLfloat value);
+    void uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+
+    void invalidate();
+
+    const Counters &counters() const { return current; }
+
+    // Returns the counters of the frame and starts a new one.
+    Counters endFrame() {
+        Counters frame = current;
+        current = Counters();
+        return frame;
+    }
+
+protected:
+
+    struct Range {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct Texture {
+        GLenum target;
+        GLuint texture;
+    };
+
+    struct Uniform {
+        int count;
+        uint32_t bits[4];
+    };
+
+    // ~0u stands for unknown, so the first call always goes through.
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    std::unordered_map<GLenum, GLuint> buffers;
+    std::unordered_map<uint64_t, Range> ranges;
+    std::vector<Texture> textures;
+    std::unordered_map<uint64_t, Uniform> uniforms;
+
+    Counters current;
+
+    // Counts the call and tells whether it has to be made.
+    bool changed(bool differs) {
+        if (differs)
+            current.issued++;
+        else
+            current.skipped++;
+        return differs;
+    }
+
+    bool setUniform(GLint location, int count, const void *values);
+
+};
@@ -2,13 +2,287 @@
 
 #include <iostream>
 #include <array>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define ENG_MATH_GL
 
+#if !defined(ENG_MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+    #define ENG_MATH_SSE
+    #include <immintrin.h>
+    #ifdef __AVX__
+        #define ENG_MATH_AVX
+    #endif
+    #ifdef __FMA__
+        #define ENG_MATH_FMA
+    #endif
+    #ifdef __F16C__
+        #define ENG_MATH_F16C
+    #endif
+#endif
+
+// Upper limit for the alignment of Vector and Matrix storage, 16, 32 or 64.
+#ifndef ENG_MATH_ALIGNMENT
+    #define ENG_MATH_ALIGNMENT 16
+#endif
+
+// Lets large matrix products run on several threads, needs -pthread.
+#ifdef ENG_MATH_THREADS
+    #include <thread>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define ENG_MATH_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+    #define ENG_MATH_IS_CONSTANT_EVALUATED() false
+#endif
+
 namespace eng {
 
+    // Approximations usable in constant expressions. Arguments are reduced
+    // to [-pi/2, pi/2] and evaluated with a Taylor series, which is within
+    // about 1e-14 of libm for arguments of moderate size.
+    namespace constant {
+
+        constexpr double pi = 3.14159265358979323846;
+
+        constexpr double sin(double x) {
+            double turns = x / (2 * pi);
+            long long n = (long long)(turns < 0 ? turns - 0.5 : turns + 0.5);
+            x -= n * 2 * pi;
+            if (x > pi / 2)
+                x = pi - x;
+            else if (x < -pi / 2)
+                x = -pi - x;
+            double term = x;
+            double sum = x;
+            for (int i = 2; i < 26; i += 2) {
+                term *= -x * x / (i * (i + 1));
+                sum += term;
+            }
+            return sum;
+        }
+
+        constexpr double cos(double x) {
+            return sin(x + pi / 2);
+        }
+
+        constexpr double tan(double x) {
+            return sin(x) / cos(x);
+        }
+
+    }
+
+    // Calls libm at run time and the approximations above at compile time.
+    namespace trig {
+
+        // Precision tags. Exact calls libm, Fast is within about 1e-7 and
+        // Faster within about 1e-4 of the true value. Both reduce arguments
+        // to a quadrant, which stays accurate up to 2^20 quarter turns,
+        // |x| below about 1.6e6. Larger arguments, infinities and NaN go
+        // through Exact instead.
+        struct Exact { };
+        struct Fast { };
+        struct Faster { };
+
+        template<typename T>
+        constexpr T sin(T x) {
+            if (ENG_MATH_IS_CONSTANT_EVALUATED())
+                return T(constant::sin(x));
+            return ::sin(x);
+        }
+
+        template<typename T>
+        constexpr T cos(T x) {
+            if (ENG_MATH_IS_CONSTANT_EVALUATED())
+                return T(constant::cos(x));
+            return ::cos(x);
+        }
+
+        template<typename T>
+        constexpr T tan(T x) {
+            if (ENG_MATH_IS_CONSTANT_EVALUATED())
+                return T(constant::tan(x));
+            return ::tan(x);
+        }
+
+        // Compilers merge the two calls into a single libm sincos.
+        template<typename T>
+        constexpr void sincos(T x, T &s, T &c, Exact = Exact()) {
+            s = sin(x);
+            c = cos(x);
+        }
+
+        // Whether 'x' is in the domain of Fast and Faster, false for NaN.
+        template<typename T>
+        constexpr bool reducible(T x) {
+            T q = x * T(2 / constant::pi);
+            return q > -T(1 << 20) && q < T(1 << 20);
+        }
+
+        // Reduces 'x' to 'r' in [-pi/4, pi/4] and returns the quadrant,
+        // pi/2 being split in three parts so that n * part is exact. 'x'
+        // must be reducible.
+        template<typename T>
+        constexpr int quadrant(T x, T &r) {
+            T q = x * T(2 / constant::pi);
+            int n = int(q < 0 ? q - T(0.5) : q + T(0.5));
+            r = x - n * T(1.5703125);
+            r -= n * T(4.837512969970703125e-4);
+            r -= n * T(7.54978995489188216e-8);
+            return n;
+        }
+
+        template<typename T>
+        constexpr void quadrantFix(int n, T ps, T pc, T &s, T &c) {
+            s = (n & 1) ? pc : ps;
+            c = (n & 1) ? ps : pc;
+            if (n & 2)
+                s = -s;
+            if ((n + 1) & 2)
+                c = -c;
+        }
+
+        template<typename T>
+        constexpr void sincos(T x, T &s, T &c, Fast) {
+            if (!reducible(x)) {
+                sincos(x, s, c, Exact());
+                return;
+            }
+            T r = 0;
+            int n = quadrant(x, r);
+            T z = r * r;
+            T ps = ((T(-1.9515295891e-4) * z + T(8.3321608736e-3)) * z - T(1.6666654611e-1)) * z * r + r;
+            T pc = ((T(2.443315711809948e-5) * z - T(1.388731625493765e-3)) * z + T(4.166664568298827e-2)) * z * z - T(0.5) * z + 1;
+            quadrantFix(n, ps, pc, s, c);
+        }
+
+        template<typename T>
+        constexpr void sincos(T x, T &s, T &c, Faster) {
+            if (!reducible(x)) {
+                sincos(x, s, c, Exact());
+                return;
+            }
+            T r = 0;
+            int n = quadrant(x, r);
+            T z = r * r;
+            T ps = (T(8.3333333e-3) * z - T(1.6666667e-1)) * z * r + r;
+            T pc = ((T(-1.3888889e-3) * z + T(4.1666667e-2)) * z - T(0.5)) * z + 1;
+            quadrantFix(n, ps, pc, s, c);
+        }
+
+        template<typename T, typename P>
+        constexpr T sin(T x, P precision) {
+            T s = 0, c = 0;
+            sincos(x, s, c, precision);
+            return s;
+        }
+
+        template<typename T, typename P>
+        constexpr T cos(T x, P precision) {
+            T s = 0, c = 0;
+            sincos(x, s, c, precision);
+            return c;
+        }
+
+        template<typename T, typename P>
+        constexpr T tan(T x, P precision) {
+            T s = 0, c = 0;
+            sincos(x, s, c, precision);
+            return s / c;
+        }
+
+    }
+
+
+    namespace memory {
+
+        // Over-allocates and stores the offset to the original block right
+        // in front of the returned pointer, so any power-of-two works.
+        inline void *alignedAlloc(size_t size, size_t alignment) {
+            unsigned char *raw = (unsigned char*)malloc(size + alignment + sizeof(size_t));
+            if (!raw)
+                return nullptr;
+            uintptr_t start = (uintptr_t)(raw + sizeof(size_t));
+            uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            ((size_t*)aligned)[-1] = aligned - (uintptr_t)raw;
+            return (void*)aligned;
+        }
+
+        inline void alignedFree(void *ptr) {
+            if (ptr)
+                free((unsigned char*)ptr - ((size_t*)ptr)[-1]);
+        }
+
+        // Alignment for the storage of Vector and Matrix. Sizes that are a
+        // multiple of 16 bytes, like Vec4f and Mat4f, get aligned to the
+        // largest power of two up to ENG_MATH_ALIGNMENT that divides them,
+        // so they fill whole SSE registers and don't straddle cache lines.
+        // Anything else keeps the alignment of T, so no padding is added.
+        constexpr size_t storageAlignment(size_t bytes, size_t natural) {
+            size_t alignment = ENG_MATH_ALIGNMENT;
+            while (alignment > 16 && bytes % alignment != 0)
+                alignment /= 2;
+            return bytes % alignment == 0 && alignment > natural ? alignment : natural;
+        }
+
+    }
+
+
+    // Standard allocator handing out blocks aligned to at least 'Alignment'
+    // bytes, by default a cache line, so that std::vector<Mat4f> keeps every
+    // matrix within one line.
+    template<typename T, size_t Alignment = 64>
+    class aligned_allocator {
+
+    public:
+
+        typedef T value_type;
+
+        static constexpr size_t alignment = Alignment > alignof(T) ? Alignment : alignof(T);
+
+        template<typename U>
+        struct rebind {
+            typedef aligned_allocator<U, Alignment> other;
+        };
+
+        aligned_allocator() noexcept { }
+
+        template<typename U>
+        aligned_allocator(const aligned_allocator<U, Alignment> &) noexcept { }
+
+        T *allocate(size_t n) {
+            void *ptr = memory::alignedAlloc(n * sizeof(T), alignment);
+            if (!ptr)
+                throw std::bad_alloc();
+            return (T*)ptr;
+        }
+
+        void deallocate(T *ptr, size_t) noexcept {
+            memory::alignedFree(ptr);
+        }
+
+        template<typename U>
+        bool operator==(const aligned_allocator<U, Alignment> &) const noexcept {
+            return true;
+        }
+
+        template<typename U>
+        bool operator!=(const aligned_allocator<U, Alignment> &) const noexcept {
+            return false;
+        }
+
+    };
+
+
     template<typename T>
     class ComplexNumber {
 
@@ -16,7 +290,7 @@ namespace eng {
 
         T r, i;
 
-        ComplexNumber(T r, T i) : r(r), i(i) { }
+        constexpr ComplexNumber(T r, T i) : r(r), i(i) { }
 
         inline T length() const {
             return sqrt(r * r + i * i);
@@ -30,31 +304,31 @@ namespace eng {
             return (*this) * (1 / this->length());
         }
 
-        inline ComplexNumber operator+(const ComplexNumber &b) const {
+        constexpr ComplexNumber operator+(const ComplexNumber &b) const {
             return ComplexNumber(r + b.r, i + b.i);
         }
 
-        inline ComplexNumber operator+(T b) const {
+        constexpr ComplexNumber operator+(T b) const {
             return ComplexNumber(r + b, i);
         }
 
-        inline ComplexNumber operator-(const ComplexNumber &b) const {
+        constexpr ComplexNumber operator-(const ComplexNumber &b) const {
             return ComplexNumber(r - b.r, i - b.i);
         }
 
-        inline ComplexNumber operator-(const T &b) const {
+        constexpr ComplexNumber operator-(const T &b) const {
             return ComplexNumber(r - b, i);
         }
 
-        inline ComplexNumber operator*(const ComplexNumber &b) const {
+        constexpr ComplexNumber operator*(const ComplexNumber &b) const {
             return ComplexNumber(r * b.r - i * b.i, r * b.i + i * b.r);
         }
 
-        inline ComplexNumber operator*(T b) const {
+        constexpr ComplexNumber operator*(T b) const {
             return ComplexNumber(r * b, i * b);
         }
 
-        inline ComplexNumber operator/(const ComplexNumber &b) const {
+        constexpr ComplexNumber operator/(const ComplexNumber &b) const {
             T d = b.r * b.r + b.i * b.i;
             return ComplexNumber(
                 (r * b.r + i * b.i) / d,
@@ -62,9 +336,8 @@ namespace eng {
             );
         }
 
-        inline ComplexNumber operator/(T b) const {
-            T d = b * b;
-            return ComplexNumber((r * b) / d, (i * b) / d);
+        constexpr ComplexNumber operator/(T b) const {
+            return ComplexNumber(r / b, i / b);
         }
 
         friend std::ostream& operator<<(std::ostream &stream, const ComplexNumber &a) {
@@ -76,25 +349,81 @@ namespace eng {
 
 
 
+#ifdef ENG_MATH_EXPRESSIONS
+
+    namespace expr {
+
+        template<int D, typename T, typename Op, typename L, typename R>
+        struct Node;
+
+    }
+
+#endif
+
+
+    // Storage layout policies for Matrix, mapping (row, col) to an index.
+    struct ColumnMajor {
+        static constexpr int index(int row, int col, int D) {
+            return col * D + row;
+        }
+    };
+
+    struct RowMajor {
+        static constexpr int index(int row, int col, int D) {
+            return row * D + col;
+        }
+    };
+
+    template<int D, typename T, typename L = ColumnMajor>
+    class Matrix;
+
+
     template<int D, typename T>
     class Vector {
         static_assert(D > 0, "Number of dimensions must be greater than 0");
 
     protected:
 
-        T data[D];
+        alignas(memory::storageAlignment(D * sizeof(T), alignof(T))) T data[D];
+
+        template<int MD, typename MT, typename ML>
+        friend class Matrix;
 
     public:
 
-        template <typename... Args>
-        Vector(Args... args) : data{ T(args)... } {
+        template <typename... Args, typename = typename std::enable_if<(sizeof...(Args) > 1 || D == 1)>::type>
+        constexpr Vector(Args... args) : data{ T(args)... } {
             static_assert(sizeof...(Args) == D, "Wrong number of arguments");
         }
 
-        Vector() { }
+        constexpr Vector() : data{ } { }
+
+        // Converts each element, e.g. between float and half vectors.
+        template<typename OT>
+        explicit constexpr Vector(const Vector<D, OT> &b) : data{ } {
+            for (int i = 0; i < D; i++)
+                data[i] = T(b[i]);
+        }
+
+#ifdef ENG_MATH_EXPRESSIONS
+
+        template<typename Op, typename L, typename R>
+        constexpr Vector(const expr::Node<D, T, Op, L, R> &e) : data{ } {
+            for (int i = 0; i < D; i++)
+                data[i] = e[i];
+        }
+
+        template<typename Op, typename L, typename R>
+        constexpr Vector & operator=(const expr::Node<D, T, Op, L, R> &e) {
+            for (int i = 0; i < D; i++)
+                data[i] = e[i];
+            return *this;
+        }
+
+#endif
 
 
-        int getDimensions() const {
+        constexpr int getDimensions() const {
             return D;
         }
 
@@ -113,42 +442,50 @@ namespace eng {
             return output;
         }
 
-        inline T operator[](int i) const {
+        constexpr T operator[](int i) const {
             return data[i];
         }
 
-        inline T & operator[](int i) {
+        constexpr T & operator[](int i) {
             return data[i];
         }
 
-        inline Vector operator+(const Vector &b) const {
+#ifndef ENG_MATH_EXPRESSIONS
+
+        constexpr Vector operator+(const Vector &b) const {
             Vector output = Vector();
             for (int i = 0; i < D; i++)
                 output[i] = (*this)[i] + b[i];
             return output;
         }
 
-        inline Vector operator-(const Vector &b) const {
+        constexpr Vector operator-(const Vector &b) const {
             Vector output = Vector();
             for (int i = 0; i < D; i++)
                 output[i] = (*this)[i] - b[i];
             return output;
         }
 
-        inline T operator*(const Vector &b) const {
+#endif
+
+        constexpr T operator*(const Vector &b) const {
             T output = 0;
             for (int i = 0; i < D; i++)
                 output += (*this)[i] * b[i];
             return output;
         }
 
-        inline Vector operator*(T b) const {
+#ifndef ENG_MATH_EXPRESSIONS
+
+        constexpr Vector operator*(T b) const {
             Vector output = Vector();
             for (int i = 0; i < D; i++)
                 output[i] = (*this)[i] * b;
             return output;
         }
 
+#endif
+
         friend std::ostream& operator<<(std::ostream &stream, const Vector &a) {
             stream << "[ " << a[0];
             for (int i = 1; i < D; i++)
@@ -166,11 +503,11 @@ namespace eng {
     public:
 
         template <typename... Args>
-        Vector3(Args... args) : Vector<3, T>(args...) { }
+        constexpr Vector3(Args... args) : Vector<3, T>(args...) { }
 
-        Vector3() { }
+        constexpr Vector3() { }
 
-        inline Vector3 cross(const Vector3 &b) const {
+        constexpr Vector3 cross(const Vector3 &b) const {
             const Vector3 &a = (*this);
             return Vector3(
                 a[1] * b[2] - a[2] * b[1],
@@ -182,25 +519,133 @@ namespace eng {
     };
 
 
+#ifdef ENG_MATH_EXPRESSIONS
+
+    // Opt-in lazy evaluation of Vector arithmetic. Sums, differences and
+    // scalar products build a tree of nodes that is evaluated in a single
+    // loop once it's assigned to a Vector or reduced by a dot product.
+    // Nodes keep references to Vector operands, so don't store them in
+    // 'auto' variables past the end of the full expression.
+    namespace expr {
+
+        struct Add {
+            template<typename T>
+            static constexpr T apply(T a, T b) { return a + b; }
+        };
+
+        struct Sub {
+            template<typename T>
+            static constexpr T apply(T a, T b) { return a - b; }
+        };
+
+        struct Mul {
+            template<typename T>
+            static constexpr T apply(T a, T b) { return a * b; }
+        };
+
+        template<typename T>
+        struct Scalar {
+            T value;
+
+            constexpr Scalar(T value) : value(value) { }
+
+            constexpr T operator[](int) const { return value; }
+        };
+
+        template<typename X>
+        struct Traits { };
+
+        template<int D, typename T>
+        struct Traits<Vector<D, T>> {
+            static const int dims = D;
+            typedef T type;
+            typedef const Vector<D, T> &operand;
+        };
+
+        template<typename T>
+        struct Traits<Vector3<T>> : Traits<Vector<3, T>> { };
+
+        template<int D, typename T, typename Op, typename L, typename R>
+        struct Traits<Node<D, T, Op, L, R>> {
+            static const int dims = D;
+            typedef T type;
+            typedef Node<D, T, Op, L, R> operand;
+        };
+
+        template<typename T>
+        struct Traits<Scalar<T>> {
+            typedef Scalar<T> operand;
+        };
+
+        template<int D, typename T, typename Op, typename L, typename R>
+        struct Node {
+            typename Traits<L>::operand l;
+            typename Traits<R>::operand r;
+
+            constexpr Node(const L &l, const R &r) : l(l), r(r) { }
+
+            constexpr T operator[](int i) const {
+                return Op::template apply<T>(l[i], r[i]);
+            }
+        };
+
+    }
+
+    template<typename L, typename R>
+    constexpr expr::Node<expr::Traits<L>::dims, typename expr::Traits<R>::type, expr::Add, L, R>
+    operator+(const L &l, const R &r) {
+        static_assert(expr::Traits<L>::dims == expr::Traits<R>::dims, "Dimensions don't match");
+        return expr::Node<expr::Traits<L>::dims, typename expr::Traits<R>::type, expr::Add, L, R>(l, r);
+    }
+
+    template<typename L, typename R>
+    constexpr expr::Node<expr::Traits<L>::dims, typename expr::Traits<R>::type, expr::Sub, L, R>
+    operator-(const L &l, const R &r) {
+        static_assert(expr::Traits<L>::dims == expr::Traits<R>::dims, "Dimensions don't match");
+        return expr::Node<expr::Traits<L>::dims, typename expr::Traits<R>::type, expr::Sub, L, R>(l, r);
+    }
+
+    template<typename L>
+    constexpr expr::Node<expr::Traits<L>::dims, typename expr::Traits<L>::type, expr::Mul, L,
+                      expr::Scalar<typename expr::Traits<L>::type>>
+    operator*(const L &l, typename expr::Traits<L>::type s) {
+        typedef expr::Scalar<typename expr::Traits<L>::type> S;
+        return expr::Node<expr::Traits<L>::dims, typename expr::Traits<L>::type, expr::Mul, L, S>(l, S(s));
+    }
+
+    template<typename L, typename R, int = expr::Traits<L>::dims>
+    constexpr typename expr::Traits<R>::type operator*(const L &l, const R &r) {
+        static_assert(expr::Traits<L>::dims == expr::Traits<R>::dims, "Dimensions don't match");
+        typename expr::Traits<R>::type output = 0;
+        for (int i = 0; i < expr::Traits<L>::dims; i++)
+            output += l[i] * r[i];
+        return output;
+    }
+
+#endif
+
+
     template<typename T>
-    class QuaternionNumber {
+    class alignas(memory::storageAlignment(4 * sizeof(T), alignof(T))) QuaternionNumber {
 
     public:
 
         T r, i, j, k;
 
-        QuaternionNumber(T r, T i, T j, T k) :
+        constexpr QuaternionNumber(T r, T i, T j, T k) :
             r(r), i(i), j(j), k(k) { }
         
-        QuaternionNumber(T angle, Vector<3, T> axis) {
-            T sin_val = sin(angle / 2);
-            r = cos(angle / 2);
-            i = axis[0] * sin_val;
-            j = axis[1] * sin_val;
-            k = axis[2] * sin_val;
+        template<typename P = trig::Exact>
+        constexpr QuaternionNumber(T angle, Vector<3, T> axis, P precision = P()) :
+            r(0), i(0), j(0), k(0) {
+            T s = 0;
+            trig::sincos(angle / 2, s, r, precision);
+            i = axis[0] * s;
+            j = axis[1] * s;
+            k = axis[2] * s;
         }
 
-        QuaternionNumber() { }
+        constexpr QuaternionNumber() : r(0), i(0), j(0), k(0) { }
 
         inline T length() const {
             return sqrt(r * r + i * i + j * j + k * k);
@@ -210,15 +655,60 @@ namespace eng {
             return (*this) * (1 / this->length());
         }
 
-        inline QuaternionNumber operator+(const QuaternionNumber &b) const {
+        constexpr T dot(const QuaternionNumber &b) const {
+            return r * b.r + i * b.i + j * b.j + k * b.k;
+        }
+
+        constexpr QuaternionNumber conjugate() const {
+            return QuaternionNumber(r, -i, -j, -k);
+        }
+
+        constexpr QuaternionNumber inverse() const {
+            return conjugate() * (1 / dot(*this));
+        }
+
+        // Rotates 'v' by a unit quaternion as v + r * t + u x t, where u is
+        // the vector part and t = 2 * u x v, instead of q * v * conjugate().
+        constexpr Vector3<T> rotate(const Vector<3, T> &v) const {
+            T tx = 2 * (j * v[2] - k * v[1]);
+            T ty = 2 * (k * v[0] - i * v[2]);
+            T tz = 2 * (i * v[1] - j * v[0]);
+            return Vector3<T>(
+                v[0] + r * tx + (j * tz - k * ty),
+                v[1] + r * ty + (k * tx - i * tz),
+                v[2] + r * tz + (i * ty - j * tx)
+            );
+        }
+
+        // Normalized linear interpolation along the shorter arc. Doesn't keep
+        // constant angular velocity, but is much cheaper than slerp.
+        static inline QuaternionNumber nlerp(const QuaternionNumber &a, const QuaternionNumber &b, T t) {
+            QuaternionNumber c = a.dot(b) < 0 ? b * T(-1) : b;
+            return (a + (c - a) * t).normalize();
+        }
+
+        // Spherical linear interpolation along the shorter arc, falls back
+        // to nlerp when the quaternions are nearly parallel.
+        static inline QuaternionNumber slerp(const QuaternionNumber &a, const QuaternionNumber &b, T t) {
+            T d = a.dot(b);
+            QuaternionNumber c = d < 0 ? b * T(-1) : b;
+            d = d < 0 ? -d : d;
+            if (d > T(0.9995))
+                return (a + (c - a) * t).normalize();
+            T theta = acos(d);
+            T s = 1 / sin(theta);
+            return a * (sin((1 - t) * theta) * s) + c * (sin(t * theta) * s);
+        }
+
+        constexpr QuaternionNumber operator+(const QuaternionNumber &b) const {
             return QuaternionNumber(r + b.r, i + b.i, j + b.j, k + b.k);
         }
 
-        inline QuaternionNumber operator-(const QuaternionNumber &b) const {
+        constexpr QuaternionNumber operator-(const QuaternionNumber &b) const {
             return QuaternionNumber(r - b.r, i - b.i, j - b.j, k - b.k);
         }
 
-        inline QuaternionNumber operator*(const QuaternionNumber &b) const {
+        constexpr QuaternionNumber operator*(const QuaternionNumber &b) const {
             return QuaternionNumber(
                 r * b.r - i * b.i - j * b.j - k * b.k,
                 r * b.i + i * b.r + j * b.k - k * b.j,
@@ -228,7 +718,7 @@ namespace eng {
         }
 
         template<typename CT>
-        inline QuaternionNumber operator*(const ComplexNumber<CT> &b) const {
+        constexpr QuaternionNumber operator*(const ComplexNumber<CT> &b) const {
             return QuaternionNumber(
                 r * b.r - i * b.i,
                 r * b.i + i * b.r,
@@ -237,7 +727,7 @@ namespace eng {
             );
         }
 
-        inline QuaternionNumber operator*(T b) const {
+        constexpr QuaternionNumber operator*(T b) const {
             return QuaternionNumber(
                 r * b, i * b, j * b, k * b
             );
@@ -254,208 +744,4449 @@ namespace eng {
 
 
 
-    template<int D, typename T>
-    class Matrix {
-        static_assert(D > 0, "Number of dimensions must be greater than 0");
+    // Matrices larger than this many bytes keep their elements on the heap,
+    // so that large D doesn't overflow the stack.
+#ifndef ENG_MATH_HEAP_THRESHOLD
+    #define ENG_MATH_HEAP_THRESHOLD 8192
+#endif
+
+    template<typename T, int N, bool Heap = (N * sizeof(T) > ENG_MATH_HEAP_THRESHOLD)>
+    class MatrixStorage {
+
+    protected:
+
+        alignas(memory::storageAlignment(N * sizeof(T), alignof(T))) T data[N];
+
+    public:
+
+        constexpr MatrixStorage() : data{ } { }
+
+        template <typename... Args, typename = typename std::enable_if<(sizeof...(Args) > 1)>::type>
+        constexpr MatrixStorage(Args... args) : data{ args... } { }
+
+    };
+
+    // Cache line aligned, zero initialized like the inline storage.
+    template<typename T, int N>
+    class MatrixStorage<T, N, true> {
 
     protected:
 
-        T data[D * D];
+        T *data;
 
     public:
 
-        Matrix(bool identity) {
-            for (int i = 0; i < D * D; i++)
+        MatrixStorage() : data(allocate()) {
+            for (int i = 0; i < N; i++)
                 data[i] = 0;
-            if (identity)
-                for (int i = 0; i < D; i++)
-                    data[i * D + i] = 1;
         }
 
-        template <typename... Args>
-        Matrix(Args... args) : data{ T(args)... } {
-            static_assert(sizeof...(Args) == D * D, "Wrong number of arguments");
+        MatrixStorage(const MatrixStorage &b) : data(allocate()) {
+            memcpy(data, b.data, N * sizeof(T));
         }
 
-        Matrix() { }
-
-
-        inline const T* operator[](int i) const {
-            return &(data[i * D]);
+        MatrixStorage(MatrixStorage &&b) : data(b.data) {
+            b.data = nullptr;
         }
 
-        inline T* operator[](int i) {
-            return &(data[i * D]);
+        // Moved-from storage has no data left and gets new one here.
+        MatrixStorage &operator=(const MatrixStorage &b) {
+            if (this == &b)
+                return *this;
+            if (!data)
+                data = allocate();
+            memcpy(data, b.data, N * sizeof(T));
+            return *this;
         }
 
-        inline Matrix operator*(const Matrix &b) const {
-            Matrix output = Matrix();
-            for (int i = 0; i < D; i++) {
-                for (int j = 0; j < D; j++) {
-                    T value = 0;
-                    for (int k = 0; k < D; k++)
-                        value += b[j][k] * (*this)[k][i];
-                    output[j][i] = value;
-                }
-            }
-            return output;
+        MatrixStorage &operator=(MatrixStorage &&b) {
+            T *tmp = data;
+            data = b.data;
+            b.data = tmp;
+            return *this;
         }
 
-        template<typename VT>
-        inline Vector<D, T> operator*(const Vector<D, VT> &v) const {
-            Vector<D, VT> output;
-            for (int i = 0; i < D; i++) {
-                T sum = 0;
-                for (int j = 0; j < D; j++)
-                    sum += (*this)[j][i] * v[j];
-                output[i] = sum;
-            }
-            return output;
+        ~MatrixStorage() {
+            memory::alignedFree(data);
         }
 
-        friend std::ostream& operator<<(std::ostream &stream, Matrix &a) {
-            for (int j = 0; j < D; j++) {
-                stream << "[ " << (a[j][0]);
-                for (int i = 1; i < D; i++)
-                    stream << ", "  << (a[j][i]);
-                stream << " ]\n";
-            }
-            return stream;
+    private:
+
+        static T *allocate() {
+            void *ptr = memory::alignedAlloc(N * sizeof(T), 64);
+            if (!ptr)
+                throw std::bad_alloc();
+            return (T*)ptr;
         }
 
     };
 
 
-    template<typename T>
-    class Matrix4x4 : public Matrix<4, T> {
+    namespace gemm {
 
-    public:
+        template<typename T>
+        void multiply(int n, const T *a, const T *b, T *c, int threads);
 
-        Matrix4x4(bool identity) : Matrix<4, T>(identity) { }
+        // Smaller products use the plain loop, packing doesn't pay off.
+        const int minimumDimension = 16;
 
-        template<typename... Args>
-        Matrix4x4(Args... args) : Matrix<4, T>(args...) { }
+    }
 
-        Matrix4x4() { }
 
+    template<int D, typename T, typename L>
+    class Matrix : protected MatrixStorage<T, D * D> {
+        static_assert(D > 0, "Number of dimensions must be greater than 0");
 
-        static Matrix4x4 translation(T x, T y, T z) {
-            Matrix4x4 output = Matrix4x4(true);
-            output[3][0] = x;
-            output[3][1] = y;
-            output[3][2] = z;
-            return output;
+    protected:
+
+        typedef MatrixStorage<T, D * D> Storage;
+        using Storage::data;
+
+    public:
+
+        typedef L Layout;
+
+        // Whether data has to be transposed by the GL on upload, pass it
+        // as the 'transpose' argument of glUniformMatrix*fv.
+        static constexpr bool GL_Transpose = std::is_same<L, RowMajor>::value;
+
+        constexpr Matrix(T value) {
+            for (int i = 0; i < D; i++)
+                data[i * D + i] = value;
         }
 
-        static Matrix4x4 scale(T x, T y, T z) {
-            Matrix4x4 output = Matrix4x4(false);
-            output[0][0] = x;
-            output[1][1] = y;
-            output[2][2] = z;
-            return output;
+        // Elements are given in storage order.
+        template <typename... Args, typename = typename std::enable_if<(sizeof...(Args) > 1)>::type>
+        constexpr Matrix(Args... args) : Storage(T(args)...) {
+            static_assert(sizeof...(Args) == D * D, "Wrong number of arguments");
         }
 
-        static Matrix4x4 xRotation(T angle) {
-            T si = sin(angle);
-            T co = cos(angle);
-            Matrix4x4 output = Matrix4x4(true);
-            output[1][1] = co;
-            output[2][1] = -si;
-            output[1][2] = si;
-            output[2][2] = co;
-            return output;
+        // Converts layout and element type.
+        template<typename OT, typename OL>
+        explicit constexpr Matrix(const Matrix<D, OT, OL> &b) {
+            for (int row = 0; row < D; row++)
+                for (int col = 0; col < D; col++)
+                    (*this)(row, col) = T(b(row, col));
         }
 
-        static Matrix4x4 yRotation(T angle) {
-            T si = sin(angle);
-            T co = cos(angle);
-            Matrix4x4 output = Matrix4x4(true);
-            output[0][0] = co;
-            output[0][2] = -si;
-            output[2][0] = si;
-            output[2][2] = co;
-            return output;
+        constexpr Matrix() { }
+
+
+        // Contiguous slice 'i' of the storage, a column for ColumnMajor
+        // and a row for RowMajor.
+        constexpr const T* operator[](int i) const {
+            return &(data[i * D]);
         }
 
-        static Matrix4x4 zRotation(T angle) {
-            T si = sin(angle);
-            T co = cos(angle);
-            Matrix4x4 output = Matrix4x4(true);
-            output[0][0] = co;
-            output[1][0] = -si;
-            output[0][1] = si;
-            output[1][1] = co;
-            return output;
+        constexpr T* operator[](int i) {
+            return &(data[i * D]);
         }
 
-        template<typename QT>
-        static Matrix4x4 rotation(const QuaternionNumber<QT> &q) {
-            T ii = q.i * q.i;
-            T ij = q.i * q.j;
-            T ik = q.i * q.k;
-            T ir = q.i * q.r;
-            T jj = q.j * q.j;
-            T jk = q.j * q.k;
-            T jr = q.j * q.r;
-            T kk = q.k * q.k;
-            T kr = q.k * q.r;
-            return Matrix4x4(
-                1 - 2 * (jj + kk), 2 * (ij - kr), 2 * (ik + jr), 0,
-                2 * (ij + kr), 1 - 2 * (ii + kk), 2 * (jk - ir), 0,
-                2 * (ik - jr), 2 * (jk + ir), 1 - 2 * (ii * jj), 0,
-                0, 0, 0, 1
-            );
+        constexpr T operator()(int row, int col) const {
+            return data[L::index(row, col, D)];
         }
 
-#ifdef ENG_MATH_GL
+        constexpr T & operator()(int row, int col) {
+            return data[L::index(row, col, D)];
+        }
 
-        static Matrix4x4 GL_Projection(
-            T fov, T width, T height,
-            T nPlane, T fPlane
-        ) {
-            T aspectRatio = width / height;
-            T yScale = (T)((1.0 / tan((fov / 2.0) * M_PI / 180)) * aspectRatio);
-            T xScale = yScale / aspectRatio;
-            T frustumLength = fPlane - nPlane;
-            Matrix4x4 output = Matrix4x4(true);
-            output[0][0] = xScale;
-            output[1][1] = yScale;
-            output[2][2] = -((fPlane + nPlane) / frustumLength);
-            output[2][3] = -1;
-            output[3][2] = -((2 * nPlane * fPlane) / frustumLength);
+        constexpr const T* elements() const {
+            return data;
+        }
+
+        constexpr Matrix transpose() const {
+            Matrix output = Matrix();
+            for (int i = 0; i < D; i++)
+                for (int j = 0; j < D; j++)
+                    output[j][i] = (*this)[i][j];
             return output;
         }
 
-        template<typename QT>
-        static Matrix4x4 GL_View(
-            T x, T y, T z,
-            const QuaternionNumber<QT> &q
-        ) {
-            return Matrix4x4();
-	    }
+        // Product of the pivots of an LU decomposition with partial pivoting.
+        constexpr T determinant() const {
+            Matrix a = *this;
+            T det = 1;
+            for (int col = 0; col < D; col++) {
+                int pivot = a.pivotRow(col);
+                if (a(pivot, col) == 0)
+                    return 0;
+                if (pivot != col) {
+                    a.swapRows(pivot, col);
+                    det = -det;
+                }
+                det *= a(col, col);
+                for (int row = col + 1; row < D; row++) {
+                    T f = a(row, col) / a(col, col);
+                    for (int c = col; c < D; c++)
+                        a(row, c) -= f * a(col, c);
+                }
+            }
+            return det;
+        }
 
-#endif
+        // Singular matrices produce non-finite elements.
+        constexpr Matrix inverse() const {
+            return gaussJordanInverse();
+        }
 
-    };
+        // From gemm::minimumDimension up products go through the blocked
+        // kernel, split across cores when built with ENG_MATH_THREADS.
+        constexpr Matrix operator*(const Matrix &b) const {
+            if (D < gemm::minimumDimension || ENG_MATH_IS_CONSTANT_EVALUATED())
+                return multiplyScalar(b);
+            return multiply(b, 0);
+        }
 
+        // Blocked product on 'threads' threads, 0 picks the count from the
+        // size and the number of cores.
+        Matrix multiply(const Matrix &b, int threads) const {
+            Matrix output;
+            if (std::is_same<L, RowMajor>::value)
+                gemm::multiply(D, b.data, data, output.data, threads);
+            else
+                gemm::multiply(D, data, b.data, output.data, threads);
+            return output;
+        }
 
-    using Complex = ComplexNumber<double>;
-    using Quaternion = QuaternionNumber<double>;
-    using Complexf = ComplexNumber<float>;
-    using Quaternionf = QuaternionNumber<float>;
+        template<typename VT>
+        constexpr Vector<D, T> operator*(const Vector<D, VT> &v) const {
+            return transformScalar(v);
+        }
 
-    using Vec2f = Vector<2, float>;
-    using Vec3f = Vector3<float>;
-    using Vec4f = Vector<4, float>;
-    using Vec2 = Vector<2, double>;
-    using Vec3 = Vector3<double>;
-    using Vec4 = Vector<4, double>;
+        // A line per column, whatever the layout, as it always printed.
+        friend std::ostream& operator<<(std::ostream &stream, const Matrix &a) {
+            for (int col = 0; col < D; col++) {
+                stream << "[ " << a(0, col);
+                for (int row = 1; row < D; row++)
+                    stream << ", "  << a(row, col);
+                stream << " ]\n";
+            }
+            return stream;
+        }
 
-    using Mat2f = Matrix<2, float>;
-    using Mat3f = Matrix<3, float>;
-    using Mat4f = Matrix4x4<float>;
-    using Mat2 = Matrix<2, double>;
-    using Mat3 = Matrix4x4<double>;
-    using Mat4 = Matrix<4, double>;
+    protected:
+
+        constexpr Matrix multiplyScalar(const Matrix &b) const {
+            Matrix output = Matrix();
+            for (int row = 0; row < D; row++) {
+                for (int col = 0; col < D; col++) {
+                    T value = 0;
+                    for (int k = 0; k < D; k++)
+                        value += (*this)(row, k) * b(k, col);
+                    output(row, col) = value;
+                }
+            }
+            return output;
+        }
+
+        template<typename VT>
+        constexpr Vector<D, T> transformScalar(const Vector<D, VT> &v) const {
+            Vector<D, T> output;
+            for (int row = 0; row < D; row++) {
+                T sum = 0;
+                for (int col = 0; col < D; col++)
+                    sum += (*this)(row, col) * v[col];
+                output[row] = sum;
+            }
+            return output;
+        }
+
+        constexpr int pivotRow(int col) const {
+            int pivot = col;
+            T best = 0;
+            for (int row = col; row < D; row++) {
+                T v = (*this)(row, col) < 0 ? -(*this)(row, col) : (*this)(row, col);
+                if (v > best) {
+                    best = v;
+                    pivot = row;
+                }
+            }
+            return pivot;
+        }
+
+        constexpr void swapRows(int a, int b) {
+            for (int c = 0; c < D; c++) {
+                T tmp = (*this)(a, c);
+                (*this)(a, c) = (*this)(b, c);
+                (*this)(b, c) = tmp;
+            }
+        }
+
+        constexpr Matrix gaussJordanInverse() const {
+            Matrix a = *this;
+            Matrix output = Matrix(T(1));
+            for (int col = 0; col < D; col++) {
+                int pivot = a.pivotRow(col);
+                a.swapRows(pivot, col);
+                output.swapRows(pivot, col);
+                T d = 1 / a(col, col);
+                for (int c = 0; c < D; c++) {
+                    a(col, c) *= d;
+                    output(col, c) *= d;
+                }
+                for (int row = 0; row < D; row++) {
+                    if (row == col)
+                        continue;
+                    T f = a(row, col);
+                    for (int c = 0; c < D; c++) {
+                        a(row, c) -= f * a(col, c);
+                        output(row, c) -= f * output(col, c);
+                    }
+                }
+            }
+            return output;
+        }
+
+    };
+
+
+#ifdef ENG_MATH_SSE
+
+    namespace simd {
+
+        // a * b + c
+        inline __m128 madd(__m128 a, __m128 b, __m128 c) {
+#ifdef ENG_MATH_FMA
+            return _mm_fmadd_ps(a, b, c);
+#else
+            return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+        }
+
+        inline __m128d madd(__m128d a, __m128d b, __m128d c) {
+#ifdef ENG_MATH_FMA
+            return _mm_fmadd_pd(a, b, c);
+#else
+            return _mm_add_pd(_mm_mul_pd(a, b), c);
+#endif
+        }
+
+#ifdef ENG_MATH_AVX
+        inline __m256 madd(__m256 a, __m256 b, __m256 c) {
+#ifdef ENG_MATH_FMA
+            return _mm256_fmadd_ps(a, b, c);
+#else
+            return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+        }
+
+        inline __m256d madd(__m256d a, __m256d b, __m256d c) {
+#ifdef ENG_MATH_FMA
+            return _mm256_fmadd_pd(a, b, c);
+#else
+            return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+        }
+
+        // Eight floats of Vector or Matrix storage.
+        inline __m256 load8(const float *p) {
+#if ENG_MATH_ALIGNMENT >= 32
+            return _mm256_load_ps(p);
+#else
+            return _mm256_loadu_ps(p);
+#endif
+        }
+
+        inline void store8(float *p, __m256 v) {
+#if ENG_MATH_ALIGNMENT >= 32
+            _mm256_store_ps(p, v);
+#else
+            _mm256_storeu_ps(p, v);
+#endif
+        }
+#endif
+
+        // Sum of all four lanes, broadcasted into every lane.
+        inline __m128 hsum(__m128 v) {
+            __m128 s = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+
+        inline __m128 dot4(__m128 a, __m128 b) {
+            return hsum(_mm_mul_ps(a, b));
+        }
+
+        // Columns are stored contiguously, so out = a * b is a sum of
+        // columns of 'a' weighted by the elements of each column of 'b'.
+        // Like the other 4x4 helpers it takes 16-byte aligned matrices, the
+        // AVX loads stay unaligned unless ENG_MATH_ALIGNMENT is 32 or more.
+        inline void multiply4x4(const float *a, const float *b, float *out) {
+#ifdef ENG_MATH_AVX
+            __m256 b01 = simd::load8(b);
+            __m256 b23 = simd::load8(b + 8);
+
+            __m128 c0 = _mm_load_ps(a);
+            __m128 c1 = _mm_load_ps(a + 4);
+            __m128 c2 = _mm_load_ps(a + 8);
+            __m128 c3 = _mm_load_ps(a + 12);
+            __m256 a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+            __m256 a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+            __m256 a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+            __m256 a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+
+            __m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+            r01 = madd(a1, _mm256_shuffle_ps(b01, b01, 0x55), r01);
+            r01 = madd(a2, _mm256_shuffle_ps(b01, b01, 0xAA), r01);
+            r01 = madd(a3, _mm256_shuffle_ps(b01, b01, 0xFF), r01);
+
+            __m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+            r23 = madd(a1, _mm256_shuffle_ps(b23, b23, 0x55), r23);
+            r23 = madd(a2, _mm256_shuffle_ps(b23, b23, 0xAA), r23);
+            r23 = madd(a3, _mm256_shuffle_ps(b23, b23, 0xFF), r23);
+
+            simd::store8(out, r01);
+            simd::store8(out + 8, r23);
+#else
+            __m128 a0 = _mm_load_ps(a);
+            __m128 a1 = _mm_load_ps(a + 4);
+            __m128 a2 = _mm_load_ps(a + 8);
+            __m128 a3 = _mm_load_ps(a + 12);
+            for (int j = 0; j < 4; j++) {
+                __m128 col = _mm_load_ps(b + j * 4);
+                __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, 0x00));
+                r = madd(a1, _mm_shuffle_ps(col, col, 0x55), r);
+                r = madd(a2, _mm_shuffle_ps(col, col, 0xAA), r);
+                r = madd(a3, _mm_shuffle_ps(col, col, 0xFF), r);
+                _mm_store_ps(out + j * 4, r);
+            }
+#endif
+        }
+
+        // Block-wise inverse using 2x2 sub-matrices, works on either storage
+        // order since inverse(transpose(m)) == transpose(inverse(m)).
+        inline __m128 mat2Mul(__m128 a, __m128 b) {
+            return _mm_add_ps(
+                _mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2)))
+            );
+        }
+
+        // adjugate(a) * b
+        inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+            return _mm_sub_ps(
+                _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)))
+            );
+        }
+
+        // a * adjugate(b)
+        inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+            return _mm_sub_ps(
+                _mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2)))
+            );
+        }
+
+        // The determinant grows with the fourth power of the elements, so
+        // the matrix is first scaled by a power of two that brings its
+        // largest element into [1, 2), and the inverse scaled back after.
+        inline void inverse4x4(const float *m, float *out) {
+            __m128 r0 = _mm_load_ps(m);
+            __m128 r1 = _mm_load_ps(m + 4);
+            __m128 r2 = _mm_load_ps(m + 8);
+            __m128 r3 = _mm_load_ps(m + 12);
+
+            __m128 sign = _mm_set1_ps(-0.f);
+            __m128 big = _mm_max_ps(_mm_max_ps(_mm_andnot_ps(sign, r0), _mm_andnot_ps(sign, r1)),
+                                    _mm_max_ps(_mm_andnot_ps(sign, r2), _mm_andnot_ps(sign, r3)));
+            big = _mm_max_ps(big, _mm_shuffle_ps(big, big, _MM_SHUFFLE(2, 3, 0, 1)));
+            big = _mm_max_ps(big, _mm_shuffle_ps(big, big, _MM_SHUFFLE(1, 0, 3, 2)));
+            __m128i exponent = _mm_and_si128(_mm_castps_si128(big), _mm_set1_epi32(0x7f800000));
+            __m128i limit = _mm_set1_epi32(253 << 23);
+            __m128i over = _mm_cmpgt_epi32(exponent, limit);
+            exponent = _mm_or_si128(_mm_andnot_si128(over, exponent), _mm_and_si128(over, limit));
+            __m128 scale = _mm_castsi128_ps(_mm_sub_epi32(_mm_set1_epi32(254 << 23), exponent));
+            r0 = _mm_mul_ps(r0, scale);
+            r1 = _mm_mul_ps(r1, scale);
+            r2 = _mm_mul_ps(r2, scale);
+            r3 = _mm_mul_ps(r3, scale);
+
+            __m128 a = _mm_movelh_ps(r0, r1);
+            __m128 b = _mm_movehl_ps(r1, r0);
+            __m128 c = _mm_movelh_ps(r2, r3);
+            __m128 d = _mm_movehl_ps(r3, r2);
+
+            // (|A|, |B|, |C|, |D|)
+            __m128 detSub = _mm_sub_ps(
+                _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+                _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0)))
+            );
+            __m128 detA = _mm_shuffle_ps(detSub, detSub, 0x00);
+            __m128 detB = _mm_shuffle_ps(detSub, detSub, 0x55);
+            __m128 detC = _mm_shuffle_ps(detSub, detSub, 0xAA);
+            __m128 detD = _mm_shuffle_ps(detSub, detSub, 0xFF);
+
+            __m128 dc = mat2AdjMul(d, c);
+            __m128 ab = mat2AdjMul(a, b);
+            __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), mat2Mul(b, dc));
+            __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), mat2Mul(c, ab));
+            __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), mat2MulAdj(d, ab));
+            __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), mat2MulAdj(a, dc));
+
+            __m128 tr = hsum(_mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0))));
+            __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+            __m128 rdet = _mm_mul_ps(_mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det), scale);
+
+            x = _mm_mul_ps(x, rdet);
+            y = _mm_mul_ps(y, rdet);
+            z = _mm_mul_ps(z, rdet);
+            w = _mm_mul_ps(w, rdet);
+
+            _mm_store_ps(out, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+            _mm_store_ps(out + 4, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+            _mm_store_ps(out + 8, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+            _mm_store_ps(out + 12, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+        }
+
+        inline __m128 transform4(const float *m, __m128 v) {
+            __m128 r = _mm_mul_ps(_mm_load_ps(m), _mm_shuffle_ps(v, v, 0x00));
+            r = madd(_mm_load_ps(m + 4), _mm_shuffle_ps(v, v, 0x55), r);
+            r = madd(_mm_load_ps(m + 8), _mm_shuffle_ps(v, v, 0xAA), r);
+            r = madd(_mm_load_ps(m + 12), _mm_shuffle_ps(v, v, 0xFF), r);
+            return r;
+        }
+
+    }
+
+
+    template<>
+    inline float Vector<4, float>::length() const {
+        return _mm_cvtss_f32(_mm_sqrt_ss(simd::dot4(_mm_load_ps(data), _mm_load_ps(data))));
+    }
+
+    template<>
+    inline Vector<4, float> Vector<4, float>::normalize() {
+        __m128 v = _mm_load_ps(data);
+        Vector output;
+        _mm_store_ps(output.data, _mm_div_ps(v, _mm_sqrt_ps(simd::dot4(v, v))));
+        return output;
+    }
+
+    template<>
+    constexpr float Vector<4, float>::operator*(const Vector &b) const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return data[0] * b.data[0] + data[1] * b.data[1] + data[2] * b.data[2] + data[3] * b.data[3];
+        return _mm_cvtss_f32(simd::dot4(_mm_load_ps(data), _mm_load_ps(b.data)));
+    }
+
+    template<>
+    constexpr Matrix<4, float> Matrix<4, float>::operator*(const Matrix &b) const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return multiplyScalar(b);
+        Matrix output;
+        simd::multiply4x4(data, b.data, output.data);
+        return output;
+    }
+
+    template<>
+    constexpr Matrix<4, float> Matrix<4, float>::inverse() const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return gaussJordanInverse();
+        Matrix output;
+        simd::inverse4x4(data, output.data);
+        return output;
+    }
+
+    template<>
+    template<>
+    constexpr Vector<4, float> Matrix<4, float>::operator*(const Vector<4, float> &v) const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return transformScalar(v);
+        Vector<4, float> output;
+        _mm_store_ps(output.data, simd::transform4(data, _mm_load_ps(v.data)));
+        return output;
+    }
+
+    // Row-major storage holds the transpose of the column-major one,
+    // so (a * b)^T = b^T * a^T and inverse(a^T) = inverse(a)^T.
+    template<>
+    constexpr Matrix<4, float, RowMajor> Matrix<4, float, RowMajor>::operator*(const Matrix &b) const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return multiplyScalar(b);
+        Matrix output;
+        simd::multiply4x4(b.data, data, output.data);
+        return output;
+    }
+
+    template<>
+    constexpr Matrix<4, float, RowMajor> Matrix<4, float, RowMajor>::inverse() const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return gaussJordanInverse();
+        Matrix output;
+        simd::inverse4x4(data, output.data);
+        return output;
+    }
+
+    template<>
+    template<>
+    constexpr Vector<4, float> Matrix<4, float, RowMajor>::operator*(const Vector<4, float> &v) const {
+        if (ENG_MATH_IS_CONSTANT_EVALUATED())
+            return transformScalar(v);
+        __m128 x = _mm_load_ps(v.data);
+        __m128 r0 = _mm_mul_ps(_mm_load_ps(data), x);
+        __m128 r1 = _mm_mul_ps(_mm_load_ps(data + 4), x);
+        __m128 r2 = _mm_mul_ps(_mm_load_ps(data + 8), x);
+        __m128 r3 = _mm_mul_ps(_mm_load_ps(data + 12), x);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        Vector<4, float> output;
+        _mm_store_ps(output.data, _mm_add_ps(_mm_add_ps(_mm_add_ps(r0, r1), r2), r3));
+        return output;
+    }
+
+#endif
+
+
+    // Blocked product of column-major n x n matrices, c = a * b, laid out
+    // like an optimized BLAS: a kc x nc panel of 'b' is packed to stay in
+    // L3, an mc x kc block of 'a' to stay in L2, and a micro-kernel keeps
+    // an mr x nr tile of 'c' in registers while it walks the depth.
+    // Threads each take their own range of rows of 'c'.
+    namespace gemm {
+
+        const int kc = 256;
+        const int mc = 128;
+        const int nc = 3072;
+
+        // Products below this size per thread don't amortize starting one.
+        const int parallelDimension = 192;
+
+        // Adds a * b to the mr x nr tile at 'c', with 'ldc' between its
+        // columns. 'a' is a packed sliver of mr rows, 'b' one of nr columns.
+        template<typename T>
+        struct Kernel {
+            static const int mr = 4;
+            static const int nr = 4;
+
+            static void run(int depth, const T *a, const T *b, T *c, int ldc) {
+                T acc[nr][mr] = { };
+                for (int k = 0; k < depth; k++, a += mr, b += nr)
+                    for (int j = 0; j < nr; j++)
+                        for (int i = 0; i < mr; i++)
+                            acc[j][i] += a[i] * b[j];
+                for (int j = 0; j < nr; j++)
+                    for (int i = 0; i < mr; i++)
+                        c[j * ldc + i] += acc[j][i];
+            }
+        };
+
+#ifdef ENG_MATH_SSE
+
+        template<>
+        struct Kernel<float> {
+#ifdef ENG_MATH_AVX
+            static const int mr = 16;
+            static const int nr = 6;
+
+            static void run(int depth, const float *a, const float *b, float *c, int ldc) {
+                __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+                __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+                __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+                __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+                __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+                __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+                for (int k = 0; k < depth; k++, a += mr, b += nr) {
+                    __m256 a0 = _mm256_load_ps(a);
+                    __m256 a1 = _mm256_load_ps(a + 8);
+                    __m256 bj = _mm256_broadcast_ss(b);
+                    c00 = simd::madd(a0, bj, c00);
+                    c01 = simd::madd(a1, bj, c01);
+                    bj = _mm256_broadcast_ss(b + 1);
+                    c10 = simd::madd(a0, bj, c10);
+                    c11 = simd::madd(a1, bj, c11);
+                    bj = _mm256_broadcast_ss(b + 2);
+                    c20 = simd::madd(a0, bj, c20);
+                    c21 = simd::madd(a1, bj, c21);
+                    bj = _mm256_broadcast_ss(b + 3);
+                    c30 = simd::madd(a0, bj, c30);
+                    c31 = simd::madd(a1, bj, c31);
+                    bj = _mm256_broadcast_ss(b + 4);
+                    c40 = simd::madd(a0, bj, c40);
+                    c41 = simd::madd(a1, bj, c41);
+                    bj = _mm256_broadcast_ss(b + 5);
+                    c50 = simd::madd(a0, bj, c50);
+                    c51 = simd::madd(a1, bj, c51);
+                }
+                __m256 tile[nr][2] = {
+                    { c00, c01 }, { c10, c11 }, { c20, c21 },
+                    { c30, c31 }, { c40, c41 }, { c50, c51 },
+                };
+                for (int j = 0; j < nr; j++, c += ldc) {
+                    _mm256_storeu_ps(c, _mm256_add_ps(_mm256_loadu_ps(c), tile[j][0]));
+                    _mm256_storeu_ps(c + 8, _mm256_add_ps(_mm256_loadu_ps(c + 8), tile[j][1]));
+                }
+            }
+#else
+            static const int mr = 8;
+            static const int nr = 4;
+
+            static void run(int depth, const float *a, const float *b, float *c, int ldc) {
+                __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+                __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+                __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+                __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+                for (int k = 0; k < depth; k++, a += mr, b += nr) {
+                    __m128 a0 = _mm_load_ps(a);
+                    __m128 a1 = _mm_load_ps(a + 4);
+                    __m128 bk = _mm_load_ps(b);
+                    __m128 bj = _mm_shuffle_ps(bk, bk, 0x00);
+                    c00 = simd::madd(a0, bj, c00);
+                    c01 = simd::madd(a1, bj, c01);
+                    bj = _mm_shuffle_ps(bk, bk, 0x55);
+                    c10 = simd::madd(a0, bj, c10);
+                    c11 = simd::madd(a1, bj, c11);
+                    bj = _mm_shuffle_ps(bk, bk, 0xAA);
+                    c20 = simd::madd(a0, bj, c20);
+                    c21 = simd::madd(a1, bj, c21);
+                    bj = _mm_shuffle_ps(bk, bk, 0xFF);
+                    c30 = simd::madd(a0, bj, c30);
+                    c31 = simd::madd(a1, bj, c31);
+                }
+                __m128 tile[nr][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 } };
+                for (int j = 0; j < nr; j++, c += ldc) {
+                    _mm_storeu_ps(c, _mm_add_ps(_mm_loadu_ps(c), tile[j][0]));
+                    _mm_storeu_ps(c + 4, _mm_add_ps(_mm_loadu_ps(c + 4), tile[j][1]));
+                }
+            }
+#endif
+        };
+
+        template<>
+        struct Kernel<double> {
+#ifdef ENG_MATH_AVX
+            static const int mr = 8;
+            static const int nr = 4;
+
+            static void run(int depth, const double *a, const double *b, double *c, int ldc) {
+                __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+                __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+                __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+                __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+                for (int k = 0; k < depth; k++, a += mr, b += nr) {
+                    __m256d a0 = _mm256_load_pd(a);
+                    __m256d a1 = _mm256_load_pd(a + 4);
+                    __m256d bj = _mm256_broadcast_sd(b);
+                    c00 = simd::madd(a0, bj, c00);
+                    c01 = simd::madd(a1, bj, c01);
+                    bj = _mm256_broadcast_sd(b + 1);
+                    c10 = simd::madd(a0, bj, c10);
+                    c11 = simd::madd(a1, bj, c11);
+                    bj = _mm256_broadcast_sd(b + 2);
+                    c20 = simd::madd(a0, bj, c20);
+                    c21 = simd::madd(a1, bj, c21);
+                    bj = _mm256_broadcast_sd(b + 3);
+                    c30 = simd::madd(a0, bj, c30);
+                    c31 = simd::madd(a1, bj, c31);
+                }
+                __m256d tile[nr][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 } };
+                for (int j = 0; j < nr; j++, c += ldc) {
+                    _mm256_storeu_pd(c, _mm256_add_pd(_mm256_loadu_pd(c), tile[j][0]));
+                    _mm256_storeu_pd(c + 4, _mm256_add_pd(_mm256_loadu_pd(c + 4), tile[j][1]));
+                }
+            }
+#else
+            static const int mr = 4;
+            static const int nr = 4;
+
+            static void run(int depth, const double *a, const double *b, double *c, int ldc) {
+                __m128d c00 = _mm_setzero_pd(), c01 = _mm_setzero_pd();
+                __m128d c10 = _mm_setzero_pd(), c11 = _mm_setzero_pd();
+                __m128d c20 = _mm_setzero_pd(), c21 = _mm_setzero_pd();
+                __m128d c30 = _mm_setzero_pd(), c31 = _mm_setzero_pd();
+                for (int k = 0; k < depth; k++, a += mr, b += nr) {
+                    __m128d a0 = _mm_load_pd(a);
+                    __m128d a1 = _mm_load_pd(a + 2);
+                    __m128d bj = _mm_load1_pd(b);
+                    c00 = simd::madd(a0, bj, c00);
+                    c01 = simd::madd(a1, bj, c01);
+                    bj = _mm_load1_pd(b + 1);
+                    c10 = simd::madd(a0, bj, c10);
+                    c11 = simd::madd(a1, bj, c11);
+                    bj = _mm_load1_pd(b + 2);
+                    c20 = simd::madd(a0, bj, c20);
+                    c21 = simd::madd(a1, bj, c21);
+                    bj = _mm_load1_pd(b + 3);
+                    c30 = simd::madd(a0, bj, c30);
+                    c31 = simd::madd(a1, bj, c31);
+                }
+                __m128d tile[nr][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 } };
+                for (int j = 0; j < nr; j++, c += ldc) {
+                    _mm_storeu_pd(c, _mm_add_pd(_mm_loadu_pd(c), tile[j][0]));
+                    _mm_storeu_pd(c + 2, _mm_add_pd(_mm_loadu_pd(c + 2), tile[j][1]));
+                }
+            }
+#endif
+        };
+
+#endif
+
+        // Rows [row, row + rows) of columns [col, col + depth) of 'a', as
+        // slivers of mr rows stored column after column, zero padded.
+        template<typename T>
+        inline void packA(int n, const T *a, int row, int rows, int col, int depth, T *out) {
+            const int mr = Kernel<T>::mr;
+            for (int i = 0; i < rows; i += mr) {
+                int height = rows - i < mr ? rows - i : mr;
+                for (int k = 0; k < depth; k++) {
+                    const T *src = a + (size_t)(col + k) * n + row + i;
+                    for (int r = 0; r < height; r++)
+                        *out++ = src[r];
+                    for (int r = height; r < mr; r++)
+                        *out++ = 0;
+                }
+            }
+        }
+
+        // Rows [row, row + depth) of columns [col, col + cols) of 'b', as
+        // slivers of nr columns stored row after row, zero padded.
+        template<typename T>
+        inline void packB(int n, const T *b, int row, int depth, int col, int cols, T *out) {
+            const int nr = Kernel<T>::nr;
+            for (int j = 0; j < cols; j += nr) {
+                int width = cols - j < nr ? cols - j : nr;
+                const T *src = b + (size_t)(col + j) * n + row;
+                for (int k = 0; k < depth; k++) {
+                    for (int c = 0; c < width; c++)
+                        *out++ = src[(size_t)c * n + k];
+                    for (int c = width; c < nr; c++)
+                        *out++ = 0;
+                }
+            }
+        }
+
+        // Elements of packing space one multiplyRows call needs, a multiple
+        // of kc so that consecutive workspaces stay 64 byte aligned.
+        template<typename T>
+        size_t workspaceSize(int n) {
+            const int nr = Kernel<T>::nr;
+            const int blockRows = mc / Kernel<T>::mr * Kernel<T>::mr;
+            const int blockCols = nc / nr * nr;
+            int panelCols = n < blockCols ? (n + nr - 1) / nr * nr : blockCols;
+            return (size_t)kc * (blockRows + panelCols);
+        }
+
+        // Rows [first, last) of c += a * b, packing into 'workspace'.
+        template<typename T>
+        void multiplyRows(int n, const T *a, const T *b, T *c, int first, int last, T *workspace) {
+            const int mr = Kernel<T>::mr;
+            const int nr = Kernel<T>::nr;
+            const int blockRows = mc / mr * mr;
+            const int blockCols = nc / nr * nr;
+
+            T *packedA = workspace;
+            T *packedB = workspace + (size_t)blockRows * kc;
+            T edge[mr * nr];
+
+            for (int jc = 0; jc < n; jc += blockCols) {
+                int cols = n - jc < blockCols ? n - jc : blockCols;
+                for (int pc = 0; pc < n; pc += kc) {
+                    int depth = n - pc < kc ? n - pc : kc;
+                    packB(n, b, pc, depth, jc, cols, packedB);
+                    for (int ic = first; ic < last; ic += blockRows) {
+                        int rows = last - ic < blockRows ? last - ic : blockRows;
+                        packA(n, a, ic, rows, pc, depth, packedA);
+                        for (int jr = 0; jr < cols; jr += nr) {
+                            const T *sliverB = packedB + (size_t)jr * depth;
+                            for (int ir = 0; ir < rows; ir += mr) {
+                                const T *sliverA = packedA + (size_t)ir * depth;
+                                T *tile = c + (size_t)(jc + jr) * n + ic + ir;
+                                if (rows - ir >= mr && cols - jr >= nr) {
+                                    Kernel<T>::run(depth, sliverA, sliverB, tile, n);
+                                    continue;
+                                }
+                                // Partial tiles go through a scratch tile.
+                                for (int i = 0; i < mr * nr; i++)
+                                    edge[i] = 0;
+                                Kernel<T>::run(depth, sliverA, sliverB, edge, mr);
+                                int height = rows - ir < mr ? rows - ir : mr;
+                                int width = cols - jr < nr ? cols - jr : nr;
+                                for (int j = 0; j < width; j++)
+                                    for (int i = 0; i < height; i++)
+                                        tile[(size_t)j * n + i] += edge[j * mr + i];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // 'c' has to be zeroed. Packing space for all threads is allocated
+        // up front, so running out of memory throws on the calling thread.
+        template<typename T>
+        void multiply(int n, const T *a, const T *b, T *c, int threads) {
+#ifdef ENG_MATH_THREADS
+            if (threads <= 0) {
+                threads = n < parallelDimension ? 1 : (int)std::thread::hardware_concurrency();
+                int most = n / (parallelDimension / 2);
+                threads = threads < most ? threads : most;
+            }
+#else
+            threads = 1;
+#endif
+            if (threads < 1)
+                threads = 1;
+            size_t size = workspaceSize<T>(n);
+            T *workspace = (T*)memory::alignedAlloc(sizeof(T) * size * threads, 64);
+            if (!workspace)
+                throw std::bad_alloc();
+
+#ifdef ENG_MATH_THREADS
+            if (threads > 1) {
+                // Row ranges in whole slivers, the first one on this thread.
+                const int mr = Kernel<T>::mr;
+                int slivers = (n + mr - 1) / mr;
+                std::vector<std::thread> workers;
+                for (int t = 1; t < threads; t++) {
+                    int first = slivers * t / threads * mr;
+                    int last = slivers * (t + 1) / threads * mr;
+                    last = last < n ? last : n;
+                    if (first < last)
+                        workers.emplace_back(multiplyRows<T>, n, a, b, c, first, last, workspace + size * t);
+                }
+                int last = slivers / threads * mr;
+                multiplyRows(n, a, b, c, 0, last < n ? last : n, workspace);
+                for (std::thread &worker : workers)
+                    worker.join();
+                memory::alignedFree(workspace);
+                return;
+            }
+#endif
+            multiplyRows(n, a, b, c, 0, n, workspace);
+            memory::alignedFree(workspace);
+        }
+
+    }
+
+
+    template<typename T, typename L = ColumnMajor>
+    class Matrix4x4 : public Matrix<4, T, L> {
+
+    public:
+
+        constexpr Matrix4x4(T value) : Matrix<4, T, L>(value) { }
+
+        template<typename... Args, typename = typename std::enable_if<(sizeof...(Args) > 1)>::type>
+        constexpr Matrix4x4(Args... args) : Matrix<4, T, L>(args...) { }
+
+        constexpr Matrix4x4(const Matrix<4, T, L> &m) : Matrix<4, T, L>(m) { }
+
+        template<typename OT, typename OL>
+        explicit constexpr Matrix4x4(const Matrix<4, OT, OL> &m) : Matrix<4, T, L>(m) { }
+
+        constexpr Matrix4x4() { }
+
+
+        static constexpr Matrix4x4 translation(T x, T y, T z) {
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(0, 3) = x;
+            output(1, 3) = y;
+            output(2, 3) = z;
+            return output;
+        }
+
+        static constexpr Matrix4x4 scale(T x, T y, T z) {
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(0, 0) = x;
+            output(1, 1) = y;
+            output(2, 2) = z;
+            return output;
+        }
+
+        template<typename P = trig::Exact>
+        static constexpr Matrix4x4 xRotation(T angle, P precision = P()) {
+            T si = 0, co = 0;
+            trig::sincos(angle, si, co, precision);
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(1, 1) = co;
+            output(1, 2) = -si;
+            output(2, 1) = si;
+            output(2, 2) = co;
+            return output;
+        }
+
+        template<typename P = trig::Exact>
+        static constexpr Matrix4x4 yRotation(T angle, P precision = P()) {
+            T si = 0, co = 0;
+            trig::sincos(angle, si, co, precision);
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(0, 0) = co;
+            output(2, 0) = -si;
+            output(0, 2) = si;
+            output(2, 2) = co;
+            return output;
+        }
+
+        template<typename P = trig::Exact>
+        static constexpr Matrix4x4 zRotation(T angle, P precision = P()) {
+            T si = 0, co = 0;
+            trig::sincos(angle, si, co, precision);
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(0, 0) = co;
+            output(0, 1) = -si;
+            output(1, 0) = si;
+            output(1, 1) = co;
+            return output;
+        }
+
+        // Inverse of a matrix whose bottom row is (0, 0, 0, 1).
+        constexpr Matrix4x4 affineInverse() const {
+            const Matrix4x4 &m = *this;
+            Vector3<T> c0(m(0, 0), m(1, 0), m(2, 0));
+            Vector3<T> c1(m(0, 1), m(1, 1), m(2, 1));
+            Vector3<T> c2(m(0, 2), m(1, 2), m(2, 2));
+            Vector3<T> t(m(0, 3), m(1, 3), m(2, 3));
+            Vector3<T> r[3] = { c1.cross(c2), c2.cross(c0), c0.cross(c1) };
+            T d = 1 / (c0 * r[0]);
+            Matrix4x4 output = Matrix4x4(T(1));
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 3; col++)
+                    output(row, col) = r[row][col] * d;
+                output(row, 3) = -(r[row] * t) * d;
+            }
+            return output;
+        }
+
+        // Inverse of a rotation followed by a translation.
+        constexpr Matrix4x4 rigidInverse() const {
+            const Matrix4x4 &m = *this;
+            Matrix4x4 output = Matrix4x4(T(1));
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 3; col++)
+                    output(row, col) = m(col, row);
+                output(row, 3) = -(m(0, row) * m(0, 3) + m(1, row) * m(1, 3) + m(2, row) * m(2, 3));
+            }
+            return output;
+        }
+
+        // transpose(inverse()) of the upper 3x3, for transforming normals.
+        constexpr Matrix<3, T, L> normalMatrix() const {
+            const Matrix4x4 &m = *this;
+            Vector3<T> c0(m(0, 0), m(1, 0), m(2, 0));
+            Vector3<T> c1(m(0, 1), m(1, 1), m(2, 1));
+            Vector3<T> c2(m(0, 2), m(1, 2), m(2, 2));
+            Vector3<T> n[3] = { c1.cross(c2), c2.cross(c0), c0.cross(c1) };
+            T d = 1 / (c0 * n[0]);
+            Matrix<3, T, L> output;
+            for (int row = 0; row < 3; row++)
+                for (int col = 0; col < 3; col++)
+                    output(row, col) = n[col][row] * d;
+            return output;
+        }
+
+#ifdef ENG_MATH_GL
+
+        template<typename P = trig::Exact>
+        static constexpr Matrix4x4 GL_Projection(
+            T fov, T width, T height,
+            T nPlane, T fPlane, P precision = P()
+        ) {
+            T aspectRatio = width / height;
+            T yScale = (1 / trig::tan((fov / 2) * T(M_PI) / 180, precision)) * aspectRatio;
+            T xScale = yScale / aspectRatio;
+            T frustumLength = fPlane - nPlane;
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(0, 0) = xScale;
+            output(1, 1) = yScale;
+            output(2, 2) = -((fPlane + nPlane) / frustumLength);
+            output(3, 2) = -1;
+            output(3, 3) = 0;
+            output(2, 3) = -((2 * nPlane * fPlane) / frustumLength);
+            return output;
+        }
+
+        template<typename QT>
+        static Matrix4x4 GL_View(
+            T x, T y, T z,
+            const QuaternionNumber<QT> &q
+        ) {
+            return Matrix4x4();
+        }
+
+#endif
+
+        // Rotation by the unit quaternion 'q'.
+        template<typename QT>
+        static constexpr Matrix4x4 rotation(const QuaternionNumber<QT> &q) {
+            T i2 = q.i + q.i, j2 = q.j + q.j, k2 = q.k + q.k;
+            T ii = q.i * i2, jj = q.j * j2, kk = q.k * k2;
+            T ij = q.i * j2, ik = q.i * k2, jk = q.j * k2;
+            T ir = q.r * i2, jr = q.r * j2, kr = q.r * k2;
+            Matrix4x4 output = Matrix4x4(T(1));
+            output(0, 0) = 1 - (jj + kk);
+            output(0, 1) = ij - kr;
+            output(0, 2) = ik + jr;
+            output(1, 0) = ij + kr;
+            output(1, 1) = 1 - (ii + kk);
+            output(1, 2) = jk - ir;
+            output(2, 0) = ik - jr;
+            output(2, 1) = jk + ir;
+            output(2, 2) = 1 - (ii + jj);
+            return output;
+        }
+
+    };
+
+
+    // Affine transform stored as the top three rows of a 4x4 matrix, the
+    // bottom row being implicitly (0, 0, 0, 1). Rows are contiguous, so
+    // data() can be uploaded as a GLSL mat4x3 with transpose set to true,
+    // or as three vec4 rows in a std140 block.
+    template<typename T>
+    class Affine3x4 {
+
+    protected:
+
+        alignas(memory::storageAlignment(12 * sizeof(T), alignof(T))) T data_[12];
+
+    public:
+
+        template <typename... Args, typename = typename std::enable_if<sizeof...(Args) == 12>::type>
+        constexpr Affine3x4(Args... args) : data_{ T(args)... } { }
+
+        constexpr Affine3x4() : data_{ } { }
+
+        explicit constexpr Affine3x4(const Matrix<4, T> &m) : data_{
+            m[0][0], m[1][0], m[2][0], m[3][0],
+            m[0][1], m[1][1], m[2][1], m[3][1],
+            m[0][2], m[1][2], m[2][2], m[3][2]
+        } { }
+
+
+        static constexpr Affine3x4 identity() {
+            return Affine3x4(
+                1, 0, 0, 0,
+                0, 1, 0, 0,
+                0, 0, 1, 0
+            );
+        }
+
+        static constexpr Affine3x4 translation(T x, T y, T z) {
+            return Affine3x4(
+                1, 0, 0, x,
+                0, 1, 0, y,
+                0, 0, 1, z
+            );
+        }
+
+        static constexpr Affine3x4 scale(T x, T y, T z) {
+            return Affine3x4(
+                x, 0, 0, 0,
+                0, y, 0, 0,
+                0, 0, z, 0
+            );
+        }
+
+        template<typename P = trig::Exact>
+        static constexpr Affine3x4 xRotation(T angle, P precision = P()) {
+            T si = 0, co = 0;
+            trig::sincos(angle, si, co, precision);
+            return Affine3x4(
+                1, 0, 0, 0,
+                0, co, -si, 0,
+                0, si, co, 0
+            );
+        }
+
+        template<typename P = trig::Exact>
+        static constexpr Affine3x4 yRotation(T angle, P precision = P()) {
+            T si = 0, co = 0;
+            trig::sincos(angle, si, co, precision);
+            return Affine3x4(
+                co, 0, si, 0,
+                0, 1, 0, 0,
+                -si, 0, co, 0
+            );
+        }
+
+        template<typename P = trig::Exact>
+        static constexpr Affine3x4 zRotation(T angle, P precision = P()) {
+            T si = 0, co = 0;
+            trig::sincos(angle, si, co, precision);
+            return Affine3x4(
+                co, -si, 0, 0,
+                si, co, 0, 0,
+                0, 0, 1, 0
+            );
+        }
+
+        // Scale, then rotate by the unit quaternion 'q', then translate.
+        template<typename QT>
+        static constexpr Affine3x4 fromTRS(
+            const Vector<3, T> &t, const QuaternionNumber<QT> &q, const Vector<3, T> &s
+        ) {
+            T i2 = q.i + q.i, j2 = q.j + q.j, k2 = q.k + q.k;
+            T ii = q.i * i2, jj = q.j * j2, kk = q.k * k2;
+            T ij = q.i * j2, ik = q.i * k2, jk = q.j * k2;
+            T ir = q.r * i2, jr = q.r * j2, kr = q.r * k2;
+            return Affine3x4(
+                (1 - (jj + kk)) * s[0], (ij - kr) * s[1], (ik + jr) * s[2], t[0],
+                (ij + kr) * s[0], (1 - (ii + kk)) * s[1], (jk - ir) * s[2], t[1],
+                (ik - jr) * s[0], (jk + ir) * s[1], (1 - (ii + jj)) * s[2], t[2]
+            );
+        }
+
+        template<typename QT>
+        static constexpr Affine3x4 rotation(const QuaternionNumber<QT> &q) {
+            return fromTRS(Vector<3, T>(0, 0, 0), q, Vector<3, T>(1, 1, 1));
+        }
+
+
+        constexpr const T* operator[](int row) const {
+            return &(data_[row * 4]);
+        }
+
+        constexpr T* operator[](int row) {
+            return &(data_[row * 4]);
+        }
+
+        constexpr const T* data() const {
+            return data_;
+        }
+
+        // 27 multiplies for the linear part and 9 for the translation.
+        constexpr Affine3x4 operator*(const Affine3x4 &b) const {
+            const Affine3x4 &a = *this;
+            Affine3x4 output = Affine3x4();
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++)
+                    output[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c];
+                output[r][3] += a[r][3];
+            }
+            return output;
+        }
+
+        constexpr Vector<3, T> transformPoint(const Vector<3, T> &p) const {
+            const Affine3x4 &a = *this;
+            return Vector<3, T>(
+                a[0][0] * p[0] + a[0][1] * p[1] + a[0][2] * p[2] + a[0][3],
+                a[1][0] * p[0] + a[1][1] * p[1] + a[1][2] * p[2] + a[1][3],
+                a[2][0] * p[0] + a[2][1] * p[1] + a[2][2] * p[2] + a[2][3]
+            );
+        }
+
+        constexpr Vector<3, T> transformDirection(const Vector<3, T> &d) const {
+            const Affine3x4 &a = *this;
+            return Vector<3, T>(
+                a[0][0] * d[0] + a[0][1] * d[1] + a[0][2] * d[2],
+                a[1][0] * d[0] + a[1][1] * d[1] + a[1][2] * d[2],
+                a[2][0] * d[0] + a[2][1] * d[1] + a[2][2] * d[2]
+            );
+        }
+
+        constexpr Affine3x4 inverse() const {
+            const Affine3x4 &a = *this;
+            Vector3<T> a0(a[0][0], a[0][1], a[0][2]);
+            Vector3<T> a1(a[1][0], a[1][1], a[1][2]);
+            Vector3<T> a2(a[2][0], a[2][1], a[2][2]);
+            Vector3<T> t(a[0][3], a[1][3], a[2][3]);
+            Vector3<T> c0 = a1.cross(a2);
+            Vector3<T> c1 = a2.cross(a0);
+            Vector3<T> c2 = a0.cross(a1);
+            T d = 1 / (a0 * c0);
+            Affine3x4 output = Affine3x4();
+            for (int r = 0; r < 3; r++) {
+                output[r][0] = c0[r] * d;
+                output[r][1] = c1[r] * d;
+                output[r][2] = c2[r] * d;
+                output[r][3] = -(output[r][0] * t[0] + output[r][1] * t[1] + output[r][2] * t[2]);
+            }
+            return output;
+        }
+
+        // transpose(inverse()) of the linear part, for transforming normals.
+        constexpr Matrix<3, T> normalMatrix() const {
+            const Affine3x4 &a = *this;
+            Vector3<T> a0(a[0][0], a[0][1], a[0][2]);
+            Vector3<T> a1(a[1][0], a[1][1], a[1][2]);
+            Vector3<T> a2(a[2][0], a[2][1], a[2][2]);
+            Vector3<T> c0 = a1.cross(a2);
+            Vector3<T> c1 = a2.cross(a0);
+            Vector3<T> c2 = a0.cross(a1);
+            T d = 1 / (a0 * c0);
+            return Matrix<3, T>(
+                c0[0] * d, c1[0] * d, c2[0] * d,
+                c0[1] * d, c1[1] * d, c2[1] * d,
+                c0[2] * d, c1[2] * d, c2[2] * d
+            );
+        }
+
+        constexpr Matrix4x4<T> toMatrix() const {
+            const Affine3x4 &a = *this;
+            return Matrix4x4<T>(
+                a[0][0], a[1][0], a[2][0], 0,
+                a[0][1], a[1][1], a[2][1], 0,
+                a[0][2], a[1][2], a[2][2], 0,
+                a[0][3], a[1][3], a[2][3], 1
+            );
+        }
+
+        friend std::ostream& operator<<(std::ostream &stream, const Affine3x4 &a) {
+            for (int r = 0; r < 3; r++) {
+                stream << "[ " << a[r][0];
+                for (int c = 1; c < 4; c++)
+                    stream << ", " << a[r][c];
+                stream << " ]\n";
+            }
+            return stream;
+        }
+
+    };
+
+#ifdef ENG_MATH_SSE
+
+    // Each output row is a combination of the rows of 'b', plus the
+    // translation of 'a' in the last lane.
+    template<>
+    constexpr Affine3x4<float> Affine3x4<float>::operator*(const Affine3x4 &b) const {
+        Affine3x4 output = Affine3x4();
+        if (ENG_MATH_IS_CONSTANT_EVALUATED()) {
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++)
+                    output[r][c] = data_[r * 4] * b[0][c] + data_[r * 4 + 1] * b[1][c] + data_[r * 4 + 2] * b[2][c];
+                output[r][3] += data_[r * 4 + 3];
+            }
+            return output;
+        }
+        __m128 b0 = _mm_load_ps(b.data_);
+        __m128 b1 = _mm_load_ps(b.data_ + 4);
+        __m128 b2 = _mm_load_ps(b.data_ + 8);
+        __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+        for (int r = 0; r < 3; r++) {
+            __m128 row = _mm_load_ps(data_ + r * 4);
+            __m128 v = _mm_and_ps(row, mask);
+            v = simd::madd(_mm_shuffle_ps(row, row, 0x00), b0, v);
+            v = simd::madd(_mm_shuffle_ps(row, row, 0x55), b1, v);
+            v = simd::madd(_mm_shuffle_ps(row, row, 0xAA), b2, v);
+            _mm_store_ps(output.data_ + r * 4, v);
+        }
+        return output;
+    }
+
+#endif
+
+
+    // Translation, rotation and scale kept apart, so composing and editing
+    // them never touches a matrix. The matrix is only rebuilt on request
+    // after something changed, static objects pay nothing per frame.
+    // Composition is exact for uniform scale, non-uniform scale combined
+    // with rotation produces shear that this representation can't hold.
+    template<typename T>
+    class Transform {
+
+    protected:
+
+        Vector3<T> translation;
+        QuaternionNumber<T> rotation;
+        Vector3<T> scale;
+
+        mutable Matrix4x4<T> matrix;
+        mutable bool dirty;
+
+    public:
+
+        constexpr Transform(const Vector3<T> &translation, const QuaternionNumber<T> &rotation,
+                            const Vector3<T> &scale) :
+            translation(translation), rotation(rotation), scale(scale), dirty(true) { }
+
+        constexpr Transform() :
+            translation(0, 0, 0), rotation(1, 0, 0, 0), scale(1, 1, 1), dirty(true) { }
+
+
+        constexpr const Vector3<T> & getTranslation() const { return translation; }
+        constexpr const QuaternionNumber<T> & getRotation() const { return rotation; }
+        constexpr const Vector3<T> & getScale() const { return scale; }
+
+        constexpr bool isDirty() const {
+            return dirty;
+        }
+
+        inline void setTranslation(const Vector3<T> &t) {
+            translation = t;
+            dirty = true;
+        }
+
+        inline void setRotation(const QuaternionNumber<T> &q) {
+            rotation = q;
+            dirty = true;
+        }
+
+        inline void setScale(const Vector3<T> &s) {
+            scale = s;
+            dirty = true;
+        }
+
+        inline void translate(const Vector3<T> &t) {
+            setTranslation(Vector3<T>(translation[0] + t[0], translation[1] + t[1], translation[2] + t[2]));
+        }
+
+        inline void rotate(const QuaternionNumber<T> &q) {
+            setRotation(q * rotation);
+        }
+
+        // Applies 'b' first, then this.
+        constexpr Transform operator*(const Transform &b) const {
+            Vector3<T> st(scale[0] * b.translation[0], scale[1] * b.translation[1], scale[2] * b.translation[2]);
+            Vector3<T> rt = rotation.rotate(st);
+            return Transform(
+                Vector3<T>(translation[0] + rt[0], translation[1] + rt[1], translation[2] + rt[2]),
+                rotation * b.rotation,
+                Vector3<T>(scale[0] * b.scale[0], scale[1] * b.scale[1], scale[2] * b.scale[2])
+            );
+        }
+
+        constexpr Vector3<T> transformPoint(const Vector3<T> &p) const {
+            Vector3<T> r = rotation.rotate(Vector3<T>(p[0] * scale[0], p[1] * scale[1], p[2] * scale[2]));
+            return Vector3<T>(r[0] + translation[0], r[1] + translation[1], r[2] + translation[2]);
+        }
+
+        constexpr Vector3<T> transformDirection(const Vector3<T> &d) const {
+            return rotation.rotate(Vector3<T>(d[0] * scale[0], d[1] * scale[1], d[2] * scale[2]));
+        }
+
+        inline void materialize() const {
+            matrix = Affine3x4<T>::fromTRS(translation, rotation, scale).toMatrix();
+            dirty = false;
+        }
+
+        inline const Matrix4x4<T> & getMatrix() const {
+            if (dirty)
+                materialize();
+            return matrix;
+        }
+
+        // Rebuilds the matrices of every dirty transform in the array,
+        // returns how many were rebuilt.
+        static int materializeDirty(const Transform *transforms, int count) {
+            int rebuilt = 0;
+            for (int i = 0; i < count; i++) {
+                if (transforms[i].dirty) {
+                    transforms[i].materialize();
+                    rebuilt++;
+                }
+            }
+            return rebuilt;
+        }
+
+    };
+
+
+    // Rigid transform as real + dual * e with e^2 = 0. The real part is the
+    // rotation, the dual part 0.5 * t * real for a translation 't'. Unlike
+    // matrices, blended dual quaternions stay rigid after normalization.
+    template<typename T>
+    class DualQuaternionNumber {
+
+    public:
+
+        QuaternionNumber<T> real, dual;
+
+        constexpr DualQuaternionNumber(const QuaternionNumber<T> &real, const QuaternionNumber<T> &dual) :
+            real(real), dual(dual) { }
+
+        constexpr DualQuaternionNumber() : real(), dual() { }
+
+
+        static constexpr DualQuaternionNumber identity() {
+            return DualQuaternionNumber(QuaternionNumber<T>(1, 0, 0, 0), QuaternionNumber<T>());
+        }
+
+        // Rotation by the unit quaternion 'q', then translation by 't'.
+        static constexpr DualQuaternionNumber fromRotationTranslation(
+            const QuaternionNumber<T> &q, const Vector<3, T> &t
+        ) {
+            return DualQuaternionNumber(q, QuaternionNumber<T>(0, t[0], t[1], t[2]) * q * T(0.5));
+        }
+
+        constexpr QuaternionNumber<T> getRotation() const {
+            return real;
+        }
+
+        constexpr Vector3<T> getTranslation() const {
+            QuaternionNumber<T> t = dual * real.conjugate();
+            return Vector3<T>(2 * t.i, 2 * t.j, 2 * t.k);
+        }
+
+        inline DualQuaternionNumber normalize() const {
+            T d = 1 / real.length();
+            return DualQuaternionNumber(real * d, dual * d);
+        }
+
+        constexpr DualQuaternionNumber conjugate() const {
+            return DualQuaternionNumber(real.conjugate(), dual.conjugate());
+        }
+
+        constexpr DualQuaternionNumber operator+(const DualQuaternionNumber &b) const {
+            return DualQuaternionNumber(real + b.real, dual + b.dual);
+        }
+
+        // Applies 'b' first, then this.
+        constexpr DualQuaternionNumber operator*(const DualQuaternionNumber &b) const {
+            return DualQuaternionNumber(real * b.real, real * b.dual + dual * b.real);
+        }
+
+        constexpr DualQuaternionNumber operator*(T b) const {
+            return DualQuaternionNumber(real * b, dual * b);
+        }
+
+        constexpr Vector3<T> transformPoint(const Vector<3, T> &p) const {
+            Vector3<T> r = real.rotate(p);
+            Vector3<T> t = getTranslation();
+            return Vector3<T>(r[0] + t[0], r[1] + t[1], r[2] + t[2]);
+        }
+
+        constexpr Vector3<T> transformDirection(const Vector<3, T> &d) const {
+            return real.rotate(d);
+        }
+
+        constexpr Affine3x4<T> toAffine() const {
+            return Affine3x4<T>::fromTRS(getTranslation(), real, Vector<3, T>(1, 1, 1));
+        }
+
+        friend std::ostream& operator<<(std::ostream &stream, const DualQuaternionNumber &a) {
+            stream << '(' << a.real << ") + (" << a.dual << ")e";
+            return stream;
+        }
+
+    };
+
+
+    // Structure of arrays storage for streams of 3D vectors.
+    // Each component lives in its own 32-byte aligned block.
+    template<typename T>
+    class Vector3Array {
+
+    protected:
+
+        T *block;
+        int count;
+        int stride;
+
+        static int paddedLength(int n) {
+            const int lanes = alignment / sizeof(T);
+            return (n + lanes - 1) / lanes * lanes;
+        }
+
+    public:
+
+        static const int alignment = 32;
+
+        explicit Vector3Array(int count) : count(count), stride(paddedLength(count)) {
+            block = (T*)memory::alignedAlloc(3 * stride * sizeof(T), alignment);
+            if (!block)
+                throw std::bad_alloc();
+        }
+
+        Vector3Array(const Vector3Array &b) : Vector3Array(b.count) {
+            if (b.block)
+                memcpy(block, b.block, 3 * stride * sizeof(T));
+        }
+
+        Vector3Array(Vector3Array &&b) : block(b.block), count(b.count), stride(b.stride) {
+            b.block = nullptr;
+            b.count = 0;
+            b.stride = 0;
+        }
+
+        Vector3Array() : block(nullptr), count(0), stride(0) { }
+
+        ~Vector3Array() {
+            memory::alignedFree(block);
+        }
+
+        Vector3Array & operator=(Vector3Array b) {
+            std::swap(block, b.block);
+            std::swap(count, b.count);
+            std::swap(stride, b.stride);
+            return *this;
+        }
+
+
+        inline int size() const {
+            return count;
+        }
+
+        inline T* x() { return block; }
+        inline T* y() { return block + stride; }
+        inline T* z() { return block + 2 * stride; }
+        inline const T* x() const { return block; }
+        inline const T* y() const { return block + stride; }
+        inline const T* z() const { return block + 2 * stride; }
+
+        inline Vector3<T> operator[](int i) const {
+            return Vector3<T>(x()[i], y()[i], z()[i]);
+        }
+
+        inline void set(int i, const Vector<3, T> &v) {
+            x()[i] = v[0];
+            y()[i] = v[1];
+            z()[i] = v[2];
+        }
+
+    };
+
+
+    namespace stream {
+
+        // Coefficients are 4 columns of 3 rows, the last column being the
+        // translation. Matrices are applied as in Matrix::operator*(Vector).
+        template<typename T>
+        inline void pointCoefficients(const Matrix<4, T> &m, T *c, bool translate) {
+            for (int col = 0; col < 4; col++)
+                for (int row = 0; row < 3; row++)
+                    c[col * 3 + row] = (col < 3 || translate) ? m[col][row] : 0;
+        }
+
+        // Cofactor matrix of the upper 3x3, which equals transpose(inverse(m))
+        // up to the determinant. Only the sign of the determinant is kept,
+        // since normals get renormalized anyway.
+        template<typename T>
+        inline void normalCoefficients(const Matrix<4, T> &m, T *c) {
+            Vector3<T> c0(m[0][0], m[0][1], m[0][2]);
+            Vector3<T> c1(m[1][0], m[1][1], m[1][2]);
+            Vector3<T> c2(m[2][0], m[2][1], m[2][2]);
+            Vector3<T> n[3] = { c1.cross(c2), c2.cross(c0), c0.cross(c1) };
+            T sign = (c0 * n[0]) < 0 ? -1 : 1;
+            for (int col = 0; col < 3; col++)
+                for (int row = 0; row < 3; row++)
+                    c[col * 3 + row] = n[col][row] * sign;
+            c[9] = c[10] = c[11] = 0;
+        }
+
+        template<typename T>
+        inline void transformRange(
+            const T *c, const T *x, const T *y, const T *z,
+            T *ox, T *oy, T *oz, int begin, int end, bool renormalize
+        ) {
+            for (int i = begin; i < end; i++) {
+                T px = x[i], py = y[i], pz = z[i];
+                T rx = c[0] * px + c[3] * py + c[6] * pz + c[9];
+                T ry = c[1] * px + c[4] * py + c[7] * pz + c[10];
+                T rz = c[2] * px + c[5] * py + c[8] * pz + c[11];
+                if (renormalize) {
+                    T d = 1 / sqrt(rx * rx + ry * ry + rz * rz);
+                    rx *= d;
+                    ry *= d;
+                    rz *= d;
+                }
+                ox[i] = rx;
+                oy[i] = ry;
+                oz[i] = rz;
+            }
+        }
+
+        template<typename T>
+        inline void transform(
+            const T *c, const T *x, const T *y, const T *z,
+            T *ox, T *oy, T *oz, int n, bool renormalize
+        ) {
+            transformRange(c, x, y, z, ox, oy, oz, 0, n, renormalize);
+        }
+
+        template<typename T>
+        inline void transformHomogeneous(
+            const Matrix<4, T> &m, const T *x, const T *y, const T *z,
+            Vector<4, T> *out, int begin, int end
+        ) {
+            for (int i = begin; i < end; i++)
+                for (int row = 0; row < 4; row++)
+                    out[i][row] = m[0][row] * x[i] + m[1][row] * y[i] + m[2][row] * z[i] + m[3][row];
+        }
+
+#ifdef ENG_MATH_SSE
+
+        inline void transform(
+            const float *c, const float *x, const float *y, const float *z,
+            float *ox, float *oy, float *oz, int n, bool renormalize
+        ) {
+            int i = 0;
+#ifdef ENG_MATH_AVX
+            __m256 w[12];
+            for (int k = 0; k < 12; k++)
+                w[k] = _mm256_set1_ps(c[k]);
+            for (; i + 8 <= n; i += 8) {
+                __m256 px = _mm256_load_ps(x + i);
+                __m256 py = _mm256_load_ps(y + i);
+                __m256 pz = _mm256_load_ps(z + i);
+                __m256 rx = simd::madd(w[0], px, simd::madd(w[3], py, simd::madd(w[6], pz, w[9])));
+                __m256 ry = simd::madd(w[1], px, simd::madd(w[4], py, simd::madd(w[7], pz, w[10])));
+                __m256 rz = simd::madd(w[2], px, simd::madd(w[5], py, simd::madd(w[8], pz, w[11])));
+                if (renormalize) {
+                    __m256 l = simd::madd(rx, rx, simd::madd(ry, ry, _mm256_mul_ps(rz, rz)));
+                    __m256 d = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(l));
+                    rx = _mm256_mul_ps(rx, d);
+                    ry = _mm256_mul_ps(ry, d);
+                    rz = _mm256_mul_ps(rz, d);
+                }
+                _mm256_store_ps(ox + i, rx);
+                _mm256_store_ps(oy + i, ry);
+                _mm256_store_ps(oz + i, rz);
+            }
+#endif
+            __m128 v[12];
+            for (int k = 0; k < 12; k++)
+                v[k] = _mm_set1_ps(c[k]);
+            for (; i + 4 <= n; i += 4) {
+                __m128 px = _mm_load_ps(x + i);
+                __m128 py = _mm_load_ps(y + i);
+                __m128 pz = _mm_load_ps(z + i);
+                __m128 rx = simd::madd(v[0], px, simd::madd(v[3], py, simd::madd(v[6], pz, v[9])));
+                __m128 ry = simd::madd(v[1], px, simd::madd(v[4], py, simd::madd(v[7], pz, v[10])));
+                __m128 rz = simd::madd(v[2], px, simd::madd(v[5], py, simd::madd(v[8], pz, v[11])));
+                if (renormalize) {
+                    __m128 l = simd::madd(rx, rx, simd::madd(ry, ry, _mm_mul_ps(rz, rz)));
+                    __m128 d = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(l));
+                    rx = _mm_mul_ps(rx, d);
+                    ry = _mm_mul_ps(ry, d);
+                    rz = _mm_mul_ps(rz, d);
+                }
+                _mm_store_ps(ox + i, rx);
+                _mm_store_ps(oy + i, ry);
+                _mm_store_ps(oz + i, rz);
+            }
+            transformRange(c, x, y, z, ox, oy, oz, i, n, renormalize);
+        }
+
+        inline void transformHomogeneous(
+            const Matrix<4, float> &m, const float *x, const float *y, const float *z,
+            Vector<4, float> *out, int begin, int end
+        ) {
+            __m128 w[16];
+            for (int col = 0; col < 4; col++)
+                for (int row = 0; row < 4; row++)
+                    w[col * 4 + row] = _mm_set1_ps(m[col][row]);
+            int i = begin;
+            for (; i + 4 <= end; i += 4) {
+                __m128 px = _mm_load_ps(x + i);
+                __m128 py = _mm_load_ps(y + i);
+                __m128 pz = _mm_load_ps(z + i);
+                __m128 r[4];
+                for (int row = 0; row < 4; row++)
+                    r[row] = simd::madd(w[row], px, simd::madd(w[4 + row], py,
+                             simd::madd(w[8 + row], pz, w[12 + row])));
+                _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+                float *o = reinterpret_cast<float*>(out + i);
+                for (int k = 0; k < 4; k++)
+                    _mm_storeu_ps(o + k * 4, r[k]);
+            }
+            transformHomogeneous<float>(m, x, y, z, out, i, end);
+        }
+
+#endif
+
+    }
+
+
+    // Affine transform of points, the bottom row of 'm' is ignored.
+    template<typename T>
+    inline void transformPoints(const Matrix<4, T> &m, const Vector3Array<T> &in, Vector3Array<T> &out) {
+        T c[12];
+        stream::pointCoefficients(m, c, true);
+        stream::transform(c, in.x(), in.y(), in.z(), out.x(), out.y(), out.z(), in.size(), false);
+    }
+
+    // Full homogeneous transform of points into an interleaved xyzw array.
+    template<typename T>
+    inline void transformPoints(const Matrix<4, T> &m, const Vector3Array<T> &in, Vector<4, T> *out) {
+        stream::transformHomogeneous(m, in.x(), in.y(), in.z(), out, 0, in.size());
+    }
+
+    template<typename T>
+    inline void transformDirections(const Matrix<4, T> &m, const Vector3Array<T> &in, Vector3Array<T> &out) {
+        T c[12];
+        stream::pointCoefficients(m, c, false);
+        stream::transform(c, in.x(), in.y(), in.z(), out.x(), out.y(), out.z(), in.size(), false);
+    }
+
+    // Transforms by the inverse transpose of the upper 3x3 and renormalizes.
+    template<typename T>
+    inline void transformNormals(const Matrix<4, T> &m, const Vector3Array<T> &in, Vector3Array<T> &out) {
+        T c[12];
+        stream::normalCoefficients(m, c);
+        stream::transform(c, in.x(), in.y(), in.z(), out.x(), out.y(), out.z(), in.size(), true);
+    }
+
+
+#ifdef ENG_MATH_SSE
+
+    namespace simd {
+
+        inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        }
+
+        inline void sinCosPolynomials(__m128 r, __m128 &s, __m128 &c, bool faster) {
+            __m128 z = _mm_mul_ps(r, r);
+            if (faster) {
+                s = madd(z, _mm_set1_ps(8.3333333e-3f), _mm_set1_ps(-1.6666667e-1f));
+                c = madd(z, _mm_set1_ps(-1.3888889e-3f), _mm_set1_ps(4.1666667e-2f));
+                c = madd(c, z, _mm_set1_ps(-0.5f));
+            } else {
+                s = madd(z, _mm_set1_ps(-1.9515295891e-4f), _mm_set1_ps(8.3321608736e-3f));
+                s = madd(s, z, _mm_set1_ps(-1.6666654611e-1f));
+                c = madd(z, _mm_set1_ps(2.443315711809948e-5f), _mm_set1_ps(-1.388731625493765e-3f));
+                c = madd(c, z, _mm_set1_ps(4.166664568298827e-2f));
+                c = madd(c, z, _mm_set1_ps(-0.5f));
+            }
+            s = madd(_mm_mul_ps(s, z), r, r);
+            c = madd(c, z, _mm_set1_ps(1.f));
+        }
+
+        // Four lanes of trig::sincos, quadrant bits are moved into the
+        // sign bit with integer shifts.
+        inline void sincos(__m128 x, __m128 &s, __m128 &c, bool faster) {
+            __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(float(2 / constant::pi))));
+            __m128 q = _mm_cvtepi32_ps(n);
+            __m128 r = madd(q, _mm_set1_ps(-1.5703125f), x);
+            r = madd(q, _mm_set1_ps(-4.837512969970703125e-4f), r);
+            r = madd(q, _mm_set1_ps(-7.54978995489188216e-8f), r);
+            __m128 ps, pc;
+            sinCosPolynomials(r, ps, pc, faster);
+            __m128i one = _mm_set1_epi32(1);
+            __m128i two = _mm_set1_epi32(2);
+            __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(n, one), one));
+            __m128 sSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(n, two), 30));
+            __m128 cSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(n, one), two), 30));
+            s = _mm_xor_ps(select(swap, pc, ps), sSign);
+            c = _mm_xor_ps(select(swap, ps, pc), cSign);
+        }
+
+        // Lanes outside of the domain of trig::reducible, as a bit mask.
+        inline int unreducible(__m128 x) {
+            __m128 q = _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_mul_ps(x, _mm_set1_ps(float(2 / constant::pi))));
+            return _mm_movemask_ps(_mm_cmpnlt_ps(q, _mm_set1_ps(float(1 << 20))));
+        }
+
+#ifdef ENG_MATH_AVX
+        inline void sinCosPolynomials(__m256 r, __m256 &s, __m256 &c, bool faster) {
+            __m256 z = _mm256_mul_ps(r, r);
+            if (faster) {
+                s = madd(z, _mm256_set1_ps(8.3333333e-3f), _mm256_set1_ps(-1.6666667e-1f));
+                c = madd(z, _mm256_set1_ps(-1.3888889e-3f), _mm256_set1_ps(4.1666667e-2f));
+                c = madd(c, z, _mm256_set1_ps(-0.5f));
+            } else {
+                s = madd(z, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+                s = madd(s, z, _mm256_set1_ps(-1.6666654611e-1f));
+                c = madd(z, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+                c = madd(c, z, _mm256_set1_ps(4.166664568298827e-2f));
+                c = madd(c, z, _mm256_set1_ps(-0.5f));
+            }
+            s = madd(_mm256_mul_ps(s, z), r, r);
+            c = madd(c, z, _mm256_set1_ps(1.f));
+        }
+
+        // Eight lanes of trig::sincos. AVX has no 256-bit integer ops, so
+        // the quadrant (q mod 4) is computed in floating point.
+        inline void sincos(__m256 x, __m256 &s, __m256 &c, bool faster) {
+            __m256 q = _mm256_round_ps(
+                _mm256_mul_ps(x, _mm256_set1_ps(float(2 / constant::pi))),
+                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC
+            );
+            __m256 r = madd(q, _mm256_set1_ps(-1.5703125f), x);
+            r = madd(q, _mm256_set1_ps(-4.837512969970703125e-4f), r);
+            r = madd(q, _mm256_set1_ps(-7.54978995489188216e-8f), r);
+            __m256 ps, pc;
+            sinCosPolynomials(r, ps, pc, faster);
+            __m256 m = madd(_mm256_floor_ps(_mm256_mul_ps(q, _mm256_set1_ps(0.25f))), _mm256_set1_ps(-4.f), q);
+            __m256 m1 = _mm256_cmp_ps(m, _mm256_set1_ps(1.f), _CMP_EQ_OQ);
+            __m256 m2 = _mm256_cmp_ps(m, _mm256_set1_ps(2.f), _CMP_EQ_OQ);
+            __m256 m3 = _mm256_cmp_ps(m, _mm256_set1_ps(3.f), _CMP_EQ_OQ);
+            __m256 swap = _mm256_or_ps(m1, m3);
+            __m256 sign = _mm256_set1_ps(-0.f);
+            __m256 sSign = _mm256_and_ps(_mm256_or_ps(m2, m3), sign);
+            __m256 cSign = _mm256_and_ps(_mm256_or_ps(m1, m2), sign);
+            s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), sSign);
+            c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), cSign);
+        }
+
+        inline int unreducible(__m256 x) {
+            __m256 q = _mm256_andnot_ps(_mm256_set1_ps(-0.f), _mm256_mul_ps(x, _mm256_set1_ps(float(2 / constant::pi))));
+            return _mm256_movemask_ps(_mm256_cmp_ps(q, _mm256_set1_ps(float(1 << 20)), _CMP_NLT_UQ));
+        }
+#endif
+
+    }
+
+#endif
+
+
+    namespace trig {
+
+        // Sine and cosine of 'n' angles.
+        template<typename T, typename P = Fast>
+        inline void sincos(const T *x, T *s, T *c, int n, P precision = P()) {
+            for (int i = 0; i < n; i++)
+                sincos(x[i], s[i], c[i], precision);
+        }
+
+#ifdef ENG_MATH_SSE
+
+        // Lanes that aren't reducible are redone with Exact, like the
+        // scalar tiers do.
+        inline void sincosRange(const float *x, float *s, float *c, int n, bool faster) {
+            int i = 0;
+#ifdef ENG_MATH_AVX
+            for (; i + 8 <= n; i += 8) {
+                __m256 vx = _mm256_loadu_ps(x + i), vs, vc;
+                simd::sincos(vx, vs, vc, faster);
+                _mm256_storeu_ps(s + i, vs);
+                _mm256_storeu_ps(c + i, vc);
+                for (int lanes = simd::unreducible(vx), k = 0; lanes; lanes >>= 1, k++)
+                    if (lanes & 1)
+                        sincos(x[i + k], s[i + k], c[i + k], Exact());
+            }
+#endif
+            for (; i + 4 <= n; i += 4) {
+                __m128 vx = _mm_loadu_ps(x + i), vs, vc;
+                simd::sincos(vx, vs, vc, faster);
+                _mm_storeu_ps(s + i, vs);
+                _mm_storeu_ps(c + i, vc);
+                for (int lanes = simd::unreducible(vx), k = 0; lanes; lanes >>= 1, k++)
+                    if (lanes & 1)
+                        sincos(x[i + k], s[i + k], c[i + k], Exact());
+            }
+            for (; i < n; i++) {
+                if (faster)
+                    sincos(x[i], s[i], c[i], Faster());
+                else
+                    sincos(x[i], s[i], c[i], Fast());
+            }
+        }
+
+        inline void sincos(const float *x, float *s, float *c, int n, Fast = Fast()) {
+            sincosRange(x, s, c, n, false);
+        }
+
+        inline void sincos(const float *x, float *s, float *c, int n, Faster) {
+            sincosRange(x, s, c, n, true);
+        }
+
+#endif
+
+    }
+
+
+    namespace stream {
+
+        template<typename T>
+        inline void blendRange(
+            const QuaternionNumber<T> *a, const QuaternionNumber<T> *b, const T *t,
+            QuaternionNumber<T> *out, int begin, int end, bool spherical
+        ) {
+            for (int i = begin; i < end; i++) {
+                if (spherical)
+                    out[i] = QuaternionNumber<T>::slerp(a[i], b[i], t[i]);
+                else
+                    out[i] = QuaternionNumber<T>::nlerp(a[i], b[i], t[i]);
+            }
+        }
+
+        template<typename T>
+        inline void blend(
+            const QuaternionNumber<T> *a, const QuaternionNumber<T> *b, const T *t,
+            QuaternionNumber<T> *out, int n, bool spherical
+        ) {
+            blendRange(a, b, t, out, 0, n, spherical);
+        }
+
+#ifdef ENG_MATH_SSE
+
+        static_assert(sizeof(QuaternionNumber<float>) == 4 * sizeof(float), "Quaternion must be 4 packed floats");
+
+        // Four quaternion pairs at a time, transposed so that each register
+        // holds one component of all four. slerp weights come from a
+        // polynomial acos (Abramowitz and Stegun 4.4.46) and the Fast tier
+        // of trig::sincos, the result is renormalized in both modes.
+        inline void blend(
+            const QuaternionNumber<float> *a, const QuaternionNumber<float> *b, const float *t,
+            QuaternionNumber<float> *out, int n, bool spherical
+        ) {
+            const float *pa = (const float*)a;
+            const float *pb = (const float*)b;
+            float *po = (float*)out;
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128 ar = _mm_loadu_ps(pa + i * 4);
+                __m128 ai = _mm_loadu_ps(pa + i * 4 + 4);
+                __m128 aj = _mm_loadu_ps(pa + i * 4 + 8);
+                __m128 ak = _mm_loadu_ps(pa + i * 4 + 12);
+                _MM_TRANSPOSE4_PS(ar, ai, aj, ak);
+                __m128 br = _mm_loadu_ps(pb + i * 4);
+                __m128 bi = _mm_loadu_ps(pb + i * 4 + 4);
+                __m128 bj = _mm_loadu_ps(pb + i * 4 + 8);
+                __m128 bk = _mm_loadu_ps(pb + i * 4 + 12);
+                _MM_TRANSPOSE4_PS(br, bi, bj, bk);
+                __m128 vt = _mm_loadu_ps(t + i);
+
+                __m128 d = _mm_mul_ps(ar, br);
+                d = simd::madd(ai, bi, d);
+                d = simd::madd(aj, bj, d);
+                d = simd::madd(ak, bk, d);
+                __m128 sign = _mm_and_ps(d, _mm_set1_ps(-0.f));
+                d = _mm_xor_ps(d, sign);
+
+                __m128 wb = vt;
+                __m128 wa = _mm_sub_ps(_mm_set1_ps(1.f), vt);
+                if (spherical) {
+                    __m128 p = _mm_set1_ps(-0.0012624911f);
+                    p = simd::madd(p, d, _mm_set1_ps(0.0066700901f));
+                    p = simd::madd(p, d, _mm_set1_ps(-0.0170881256f));
+                    p = simd::madd(p, d, _mm_set1_ps(0.0308918810f));
+                    p = simd::madd(p, d, _mm_set1_ps(-0.0501743046f));
+                    p = simd::madd(p, d, _mm_set1_ps(0.0889789874f));
+                    p = simd::madd(p, d, _mm_set1_ps(-0.2145988016f));
+                    p = simd::madd(p, d, _mm_set1_ps(1.5707963050f));
+                    __m128 theta = _mm_mul_ps(p, _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.f), d), _mm_setzero_ps())));
+                    __m128 sinA, sinB, sinT, unused;
+                    simd::sincos(_mm_mul_ps(wa, theta), sinA, unused, false);
+                    simd::sincos(_mm_mul_ps(wb, theta), sinB, unused, false);
+                    simd::sincos(theta, sinT, unused, false);
+                    __m128 far = _mm_cmple_ps(d, _mm_set1_ps(0.9995f));
+                    __m128 rs = _mm_div_ps(_mm_set1_ps(1.f), sinT);
+                    wa = simd::select(far, _mm_mul_ps(sinA, rs), wa);
+                    wb = simd::select(far, _mm_mul_ps(sinB, rs), wb);
+                }
+                wb = _mm_xor_ps(wb, sign);
+
+                __m128 orr = simd::madd(wb, br, _mm_mul_ps(wa, ar));
+                __m128 oi = simd::madd(wb, bi, _mm_mul_ps(wa, ai));
+                __m128 oj = simd::madd(wb, bj, _mm_mul_ps(wa, aj));
+                __m128 ok = simd::madd(wb, bk, _mm_mul_ps(wa, ak));
+                __m128 len = _mm_mul_ps(orr, orr);
+                len = simd::madd(oi, oi, len);
+                len = simd::madd(oj, oj, len);
+                len = simd::madd(ok, ok, len);
+                __m128 rl = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len));
+                orr = _mm_mul_ps(orr, rl);
+                oi = _mm_mul_ps(oi, rl);
+                oj = _mm_mul_ps(oj, rl);
+                ok = _mm_mul_ps(ok, rl);
+                _MM_TRANSPOSE4_PS(orr, oi, oj, ok);
+                _mm_storeu_ps(po + i * 4, orr);
+                _mm_storeu_ps(po + i * 4 + 4, oi);
+                _mm_storeu_ps(po + i * 4 + 8, oj);
+                _mm_storeu_ps(po + i * 4 + 12, ok);
+            }
+            blendRange(a, b, t, out, i, n, spherical);
+        }
+
+#endif
+
+    }
+
+
+    template<typename T>
+    inline void nlerp(
+        const QuaternionNumber<T> *a, const QuaternionNumber<T> *b, const T *t,
+        QuaternionNumber<T> *out, int n
+    ) {
+        stream::blend(a, b, t, out, n, false);
+    }
+
+    template<typename T>
+    inline void slerp(
+        const QuaternionNumber<T> *a, const QuaternionNumber<T> *b, const T *t,
+        QuaternionNumber<T> *out, int n
+    ) {
+        stream::blend(a, b, t, out, n, true);
+    }
+
+
+    namespace stream {
+
+        // Bones and weights hold 4 influences per vertex. Unused influences
+        // need a zero weight, but still a valid bone index.
+        template<typename T>
+        inline void skinLinearRange(
+            const Affine3x4<T> *palette, const int *bones, const T *weights,
+            const T *px, const T *py, const T *pz, const T *nx, const T *ny, const T *nz,
+            T *opx, T *opy, T *opz, T *onx, T *ony, T *onz, int begin, int end
+        ) {
+            for (int i = begin; i < end; i++) {
+                T m[12] = { };
+                for (int k = 0; k < 4; k++) {
+                    T w = weights[i * 4 + k];
+                    const T *b = palette[bones[i * 4 + k]].data();
+                    for (int c = 0; c < 12; c++)
+                        m[c] += w * b[c];
+                }
+                T x = px[i], y = py[i], z = pz[i];
+                opx[i] = m[0] * x + m[1] * y + m[2] * z + m[3];
+                opy[i] = m[4] * x + m[5] * y + m[6] * z + m[7];
+                opz[i] = m[8] * x + m[9] * y + m[10] * z + m[11];
+                x = nx[i], y = ny[i], z = nz[i];
+                T rx = m[0] * x + m[1] * y + m[2] * z;
+                T ry = m[4] * x + m[5] * y + m[6] * z;
+                T rz = m[8] * x + m[9] * y + m[10] * z;
+                T d = 1 / sqrt(rx * rx + ry * ry + rz * rz);
+                onx[i] = rx * d;
+                ony[i] = ry * d;
+                onz[i] = rz * d;
+            }
+        }
+
+        // Influences with a real part opposite to the first one are negated,
+        // so the blend follows the shorter arc.
+        template<typename T>
+        inline void skinDualRange(
+            const DualQuaternionNumber<T> *palette, const int *bones, const T *weights,
+            const T *px, const T *py, const T *pz, const T *nx, const T *ny, const T *nz,
+            T *opx, T *opy, T *opz, T *onx, T *ony, T *onz, int begin, int end
+        ) {
+            for (int i = begin; i < end; i++) {
+                const QuaternionNumber<T> &first = palette[bones[i * 4]].real;
+                DualQuaternionNumber<T> b;
+                for (int k = 0; k < 4; k++) {
+                    const DualQuaternionNumber<T> &d = palette[bones[i * 4 + k]];
+                    T w = weights[i * 4 + k];
+                    b = b + d * (d.real.dot(first) < 0 ? -w : w);
+                }
+                b = b.normalize();
+                Vector3<T> p = b.transformPoint(Vector3<T>(px[i], py[i], pz[i]));
+                Vector3<T> n = b.transformDirection(Vector3<T>(nx[i], ny[i], nz[i]));
+                opx[i] = p[0];
+                opy[i] = p[1];
+                opz[i] = p[2];
+                onx[i] = n[0];
+                ony[i] = n[1];
+                onz[i] = n[2];
+            }
+        }
+
+        template<typename T>
+        inline void skinLinear(
+            const Affine3x4<T> *palette, const int *bones, const T *weights,
+            const T *px, const T *py, const T *pz, const T *nx, const T *ny, const T *nz,
+            T *opx, T *opy, T *opz, T *onx, T *ony, T *onz, int begin, int end
+        ) {
+            skinLinearRange(palette, bones, weights, px, py, pz, nx, ny, nz, opx, opy, opz, onx, ony, onz, begin, end);
+        }
+
+        template<typename T>
+        inline void skinDual(
+            const DualQuaternionNumber<T> *palette, const int *bones, const T *weights,
+            const T *px, const T *py, const T *pz, const T *nx, const T *ny, const T *nz,
+            T *opx, T *opy, T *opz, T *onx, T *ony, T *onz, int begin, int end
+        ) {
+            skinDualRange(palette, bones, weights, px, py, pz, nx, ny, nz, opx, opy, opz, onx, ony, onz, begin, end);
+        }
+
+#ifdef ENG_MATH_SSE
+
+        static_assert(sizeof(Affine3x4<float>) == 12 * sizeof(float), "Affine3x4 must be 12 packed floats");
+        static_assert(sizeof(DualQuaternionNumber<float>) == 8 * sizeof(float), "Dual quaternion must be 8 packed floats");
+
+        // Loads 4 floats at 'offset' of the palette entries of four vertices
+        // and transposes them, out[c] then holds element 'c' of every vertex.
+        // 'bones' points at the influence of the first vertex.
+        inline void gatherBones(const float *palette, int size, const int *bones, int offset, __m128 *out) {
+            out[0] = _mm_loadu_ps(palette + bones[0] * size + offset);
+            out[1] = _mm_loadu_ps(palette + bones[4] * size + offset);
+            out[2] = _mm_loadu_ps(palette + bones[8] * size + offset);
+            out[3] = _mm_loadu_ps(palette + bones[12] * size + offset);
+            _MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+        }
+
+        inline void gatherWeights(const float *weights, __m128 *w) {
+            w[0] = _mm_loadu_ps(weights);
+            w[1] = _mm_loadu_ps(weights + 4);
+            w[2] = _mm_loadu_ps(weights + 8);
+            w[3] = _mm_loadu_ps(weights + 12);
+            _MM_TRANSPOSE4_PS(w[0], w[1], w[2], w[3]);
+        }
+
+        // Four vertices at a time, blending the palette rows in registers.
+        inline void skinLinear(
+            const Affine3x4<float> *palette, const int *bones, const float *weights,
+            const float *px, const float *py, const float *pz, const float *nx, const float *ny, const float *nz,
+            float *opx, float *opy, float *opz, float *onx, float *ony, float *onz, int begin, int end
+        ) {
+            const float *pal = palette[0].data();
+            int i = begin;
+            for (; i + 4 <= end; i += 4) {
+                __m128 w[4], m[12], g[12];
+                gatherWeights(weights + i * 4, w);
+                for (int c = 0; c < 12; c++)
+                    m[c] = _mm_setzero_ps();
+                for (int k = 0; k < 4; k++) {
+                    gatherBones(pal, 12, bones + i * 4 + k, 0, g);
+                    gatherBones(pal, 12, bones + i * 4 + k, 4, g + 4);
+                    gatherBones(pal, 12, bones + i * 4 + k, 8, g + 8);
+                    for (int c = 0; c < 12; c++)
+                        m[c] = simd::madd(w[k], g[c], m[c]);
+                }
+
+                __m128 x = _mm_loadu_ps(px + i);
+                __m128 y = _mm_loadu_ps(py + i);
+                __m128 z = _mm_loadu_ps(pz + i);
+                _mm_storeu_ps(opx + i, simd::madd(m[0], x, simd::madd(m[1], y, simd::madd(m[2], z, m[3]))));
+                _mm_storeu_ps(opy + i, simd::madd(m[4], x, simd::madd(m[5], y, simd::madd(m[6], z, m[7]))));
+                _mm_storeu_ps(opz + i, simd::madd(m[8], x, simd::madd(m[9], y, simd::madd(m[10], z, m[11]))));
+
+                x = _mm_loadu_ps(nx + i);
+                y = _mm_loadu_ps(ny + i);
+                z = _mm_loadu_ps(nz + i);
+                __m128 rx = simd::madd(m[0], x, simd::madd(m[1], y, _mm_mul_ps(m[2], z)));
+                __m128 ry = simd::madd(m[4], x, simd::madd(m[5], y, _mm_mul_ps(m[6], z)));
+                __m128 rz = simd::madd(m[8], x, simd::madd(m[9], y, _mm_mul_ps(m[10], z)));
+                __m128 len = simd::madd(rx, rx, simd::madd(ry, ry, _mm_mul_ps(rz, rz)));
+                __m128 d = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len));
+                _mm_storeu_ps(onx + i, _mm_mul_ps(rx, d));
+                _mm_storeu_ps(ony + i, _mm_mul_ps(ry, d));
+                _mm_storeu_ps(onz + i, _mm_mul_ps(rz, d));
+            }
+            skinLinearRange(palette, bones, weights, px, py, pz, nx, ny, nz, opx, opy, opz, onx, ony, onz, i, end);
+        }
+
+        // Four vertices at a time. The rotation uses the two-cross-product
+        // form of QuaternionNumber::rotate, the translation is
+        // 2 * (rw * dv - dw * rv + rv x dv).
+        inline void skinDual(
+            const DualQuaternionNumber<float> *palette, const int *bones, const float *weights,
+            const float *px, const float *py, const float *pz, const float *nx, const float *ny, const float *nz,
+            float *opx, float *opy, float *opz, float *onx, float *ony, float *onz, int begin, int end
+        ) {
+            const float *pal = (const float*)palette;
+            __m128 two = _mm_set1_ps(2.f);
+            int i = begin;
+            for (; i + 4 <= end; i += 4) {
+                __m128 w[4], q[8], g[8], first[4];
+                gatherWeights(weights + i * 4, w);
+                gatherBones(pal, 8, bones + i * 4, 0, first);
+                for (int c = 0; c < 8; c++)
+                    q[c] = _mm_setzero_ps();
+                for (int k = 0; k < 4; k++) {
+                    gatherBones(pal, 8, bones + i * 4 + k, 0, g);
+                    gatherBones(pal, 8, bones + i * 4 + k, 4, g + 4);
+                    __m128 dot = _mm_mul_ps(g[0], first[0]);
+                    dot = simd::madd(g[1], first[1], dot);
+                    dot = simd::madd(g[2], first[2], dot);
+                    dot = simd::madd(g[3], first[3], dot);
+                    __m128 wk = _mm_xor_ps(w[k], _mm_and_ps(dot, _mm_set1_ps(-0.f)));
+                    for (int c = 0; c < 8; c++)
+                        q[c] = simd::madd(wk, g[c], q[c]);
+                }
+
+                __m128 len = simd::madd(q[0], q[0], simd::madd(q[1], q[1], simd::madd(q[2], q[2], _mm_mul_ps(q[3], q[3]))));
+                __m128 d = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len));
+                for (int c = 0; c < 8; c++)
+                    q[c] = _mm_mul_ps(q[c], d);
+                __m128 rw = q[0], rx = q[1], ry = q[2], rz = q[3];
+                __m128 dw = q[4], dx = q[5], dy = q[6], dz = q[7];
+
+                __m128 tx = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dx), _mm_mul_ps(dw, rx)),
+                                                       _mm_sub_ps(_mm_mul_ps(ry, dz), _mm_mul_ps(rz, dy))));
+                __m128 ty = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dy), _mm_mul_ps(dw, ry)),
+                                                       _mm_sub_ps(_mm_mul_ps(rz, dx), _mm_mul_ps(rx, dz))));
+                __m128 tz = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dz), _mm_mul_ps(dw, rz)),
+                                                       _mm_sub_ps(_mm_mul_ps(rx, dy), _mm_mul_ps(ry, dx))));
+
+                for (int pass = 0; pass < 2; pass++) {
+                    const float *sx = pass ? nx : px, *sy = pass ? ny : py, *sz = pass ? nz : pz;
+                    float *ox = pass ? onx : opx, *oy = pass ? ony : opy, *oz = pass ? onz : opz;
+                    __m128 x = _mm_loadu_ps(sx + i);
+                    __m128 y = _mm_loadu_ps(sy + i);
+                    __m128 z = _mm_loadu_ps(sz + i);
+                    __m128 cx = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(ry, z), _mm_mul_ps(rz, y)));
+                    __m128 cy = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(rz, x), _mm_mul_ps(rx, z)));
+                    __m128 cz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(rx, y), _mm_mul_ps(ry, x)));
+                    x = simd::madd(rw, cx, _mm_add_ps(x, _mm_sub_ps(_mm_mul_ps(ry, cz), _mm_mul_ps(rz, cy))));
+                    y = simd::madd(rw, cy, _mm_add_ps(y, _mm_sub_ps(_mm_mul_ps(rz, cx), _mm_mul_ps(rx, cz))));
+                    z = simd::madd(rw, cz, _mm_add_ps(z, _mm_sub_ps(_mm_mul_ps(rx, cy), _mm_mul_ps(ry, cx))));
+                    if (!pass) {
+                        x = _mm_add_ps(x, tx);
+                        y = _mm_add_ps(y, ty);
+                        z = _mm_add_ps(z, tz);
+                    }
+                    _mm_storeu_ps(ox + i, x);
+                    _mm_storeu_ps(oy + i, y);
+                    _mm_storeu_ps(oz + i, z);
+                }
+            }
+            skinDualRange(palette, bones, weights, px, py, pz, nx, ny, nz, opx, opy, opz, onx, ony, onz, i, end);
+        }
+
+#endif
+
+    }
+
+
+    // Linear blend skinning of vertices [begin, end), with 4 bone indices
+    // and weights per vertex. Disjoint ranges can run on separate threads.
+    template<typename T>
+    inline void skinLinear(
+        const Affine3x4<T> *palette, const int *bones, const T *weights,
+        const Vector3Array<T> &positions, const Vector3Array<T> &normals,
+        Vector3Array<T> &outPositions, Vector3Array<T> &outNormals, int begin, int end
+    ) {
+        stream::skinLinear(
+            palette, bones, weights,
+            positions.x(), positions.y(), positions.z(), normals.x(), normals.y(), normals.z(),
+            outPositions.x(), outPositions.y(), outPositions.z(),
+            outNormals.x(), outNormals.y(), outNormals.z(), begin, end
+        );
+    }
+
+    template<typename T>
+    inline void skinLinear(
+        const Affine3x4<T> *palette, const int *bones, const T *weights,
+        const Vector3Array<T> &positions, const Vector3Array<T> &normals,
+        Vector3Array<T> &outPositions, Vector3Array<T> &outNormals
+    ) {
+        skinLinear(palette, bones, weights, positions, normals, outPositions, outNormals, 0, positions.size());
+    }
+
+    // Dual quaternion skinning, same layout as skinLinear. Avoids the volume
+    // loss of linear blending around twisting joints.
+    template<typename T>
+    inline void skinDualQuaternion(
+        const DualQuaternionNumber<T> *palette, const int *bones, const T *weights,
+        const Vector3Array<T> &positions, const Vector3Array<T> &normals,
+        Vector3Array<T> &outPositions, Vector3Array<T> &outNormals, int begin, int end
+    ) {
+        stream::skinDual(
+            palette, bones, weights,
+            positions.x(), positions.y(), positions.z(), normals.x(), normals.y(), normals.z(),
+            outPositions.x(), outPositions.y(), outPositions.z(),
+            outNormals.x(), outNormals.y(), outNormals.z(), begin, end
+        );
+    }
+
+    template<typename T>
+    inline void skinDualQuaternion(
+        const DualQuaternionNumber<T> *palette, const int *bones, const T *weights,
+        const Vector3Array<T> &positions, const Vector3Array<T> &normals,
+        Vector3Array<T> &outPositions, Vector3Array<T> &outNormals
+    ) {
+        skinDualQuaternion(palette, bones, weights, positions, normals, outPositions, outNormals, 0, positions.size());
+    }
+
+
+    namespace simd {
+
+        // Common interface over the widest vectors available for T, so that
+        // array kernels can be written once. Scalar is the one element
+        // fallback, also used for the tails.
+        template<typename T>
+        struct Scalar {
+            typedef T V;
+            typedef T Element;
+            static const int lanes = 1;
+            static V load(const T *p) { return *p; }
+            static void store(T *p, V v) { *p = v; }
+            static V set1(T v) { return v; }
+            static V add(V a, V b) { return a + b; }
+            static V sub(V a, V b) { return a - b; }
+            static V mul(V a, V b) { return a * b; }
+            static V div(V a, V b) { return a / b; }
+            static V sqrt(V a) { return ::sqrt(a); }
+            static V min(V a, V b) { return b < a ? b : a; }
+            static V max(V a, V b) { return a < b ? b : a; }
+            static int negativeMask(V a) { return a < 0 ? 1 : 0; }
+            static void transpose(V *) { }
+        };
+
+        // transpose() works on lanes x lanes values, negativeMask() has
+        // bit i set where lane i is less than zero.
+        template<typename T>
+        struct Lanes : Scalar<T> { };
+
+#ifdef ENG_MATH_SSE
+
+#ifdef ENG_MATH_AVX
+        template<>
+        struct Lanes<float> {
+            typedef __m256 V;
+            typedef float Element;
+            static const int lanes = 8;
+            static V load(const float *p) { return _mm256_loadu_ps(p); }
+            static void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+            static V set1(float v) { return _mm256_set1_ps(v); }
+            static V add(V a, V b) { return _mm256_add_ps(a, b); }
+            static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+            static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+            static V div(V a, V b) { return _mm256_div_ps(a, b); }
+            static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+            static V min(V a, V b) { return _mm256_min_ps(a, b); }
+            static V max(V a, V b) { return _mm256_max_ps(a, b); }
+            static int negativeMask(V a) { return _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ)); }
+
+            static void transpose(V *v) {
+                __m256 t0 = _mm256_unpacklo_ps(v[0], v[1]);
+                __m256 t1 = _mm256_unpackhi_ps(v[0], v[1]);
+                __m256 t2 = _mm256_unpacklo_ps(v[2], v[3]);
+                __m256 t3 = _mm256_unpackhi_ps(v[2], v[3]);
+                __m256 t4 = _mm256_unpacklo_ps(v[4], v[5]);
+                __m256 t5 = _mm256_unpackhi_ps(v[4], v[5]);
+                __m256 t6 = _mm256_unpacklo_ps(v[6], v[7]);
+                __m256 t7 = _mm256_unpackhi_ps(v[6], v[7]);
+                __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+                __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+                __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+                __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+                __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+                __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+                __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+                __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+                v[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+                v[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+                v[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+                v[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+                v[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+                v[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+                v[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+                v[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+            }
+        };
+
+        template<>
+        struct Lanes<double> {
+            typedef __m256d V;
+            typedef double Element;
+            static const int lanes = 4;
+            static V load(const double *p) { return _mm256_loadu_pd(p); }
+            static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+            static V set1(double v) { return _mm256_set1_pd(v); }
+            static V add(V a, V b) { return _mm256_add_pd(a, b); }
+            static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+            static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+            static V div(V a, V b) { return _mm256_div_pd(a, b); }
+            static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+            static V min(V a, V b) { return _mm256_min_pd(a, b); }
+            static V max(V a, V b) { return _mm256_max_pd(a, b); }
+            static int negativeMask(V a) { return _mm256_movemask_pd(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_LT_OQ)); }
+
+            static void transpose(V *v) {
+                __m256d t0 = _mm256_unpacklo_pd(v[0], v[1]);
+                __m256d t1 = _mm256_unpackhi_pd(v[0], v[1]);
+                __m256d t2 = _mm256_unpacklo_pd(v[2], v[3]);
+                __m256d t3 = _mm256_unpackhi_pd(v[2], v[3]);
+                v[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+                v[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+                v[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+                v[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+            }
+        };
+#else
+        template<>
+        struct Lanes<float> {
+            typedef __m128 V;
+            typedef float Element;
+            static const int lanes = 4;
+            static V load(const float *p) { return _mm_loadu_ps(p); }
+            static void store(float *p, V v) { _mm_storeu_ps(p, v); }
+            static V set1(float v) { return _mm_set1_ps(v); }
+            static V add(V a, V b) { return _mm_add_ps(a, b); }
+            static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+            static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+            static V div(V a, V b) { return _mm_div_ps(a, b); }
+            static V sqrt(V a) { return _mm_sqrt_ps(a); }
+            static V min(V a, V b) { return _mm_min_ps(a, b); }
+            static V max(V a, V b) { return _mm_max_ps(a, b); }
+            static int negativeMask(V a) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())); }
+
+            static void transpose(V *v) {
+                _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+            }
+        };
+
+        template<>
+        struct Lanes<double> {
+            typedef __m128d V;
+            typedef double Element;
+            static const int lanes = 2;
+            static V load(const double *p) { return _mm_loadu_pd(p); }
+            static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+            static V set1(double v) { return _mm_set1_pd(v); }
+            static V add(V a, V b) { return _mm_add_pd(a, b); }
+            static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+            static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+            static V div(V a, V b) { return _mm_div_pd(a, b); }
+            static V sqrt(V a) { return _mm_sqrt_pd(a); }
+            static V min(V a, V b) { return _mm_min_pd(a, b); }
+            static V max(V a, V b) { return _mm_max_pd(a, b); }
+            static int negativeMask(V a) { return _mm_movemask_pd(_mm_cmplt_pd(a, _mm_setzero_pd())); }
+
+            static void transpose(V *v) {
+                __m128d t0 = _mm_unpacklo_pd(v[0], v[1]);
+                v[1] = _mm_unpackhi_pd(v[0], v[1]);
+                v[0] = t0;
+            }
+        };
+#endif
+
+#endif
+
+    }
+
+
+    // Structure of arrays storage for complex numbers, real and imaginary
+    // parts each in their own 32-byte aligned block.
+    template<typename T>
+    class ComplexArray {
+
+    protected:
+
+        T *block;
+        int count;
+        int stride;
+
+        static int paddedLength(int n) {
+            const int lanes = alignment / sizeof(T);
+            return (n + lanes - 1) / lanes * lanes;
+        }
+
+    public:
+
+        static const int alignment = 32;
+
+        explicit ComplexArray(int count) : count(count), stride(paddedLength(count)) {
+            block = (T*)memory::alignedAlloc(2 * stride * sizeof(T), alignment);
+            if (!block)
+                throw std::bad_alloc();
+        }
+
+        ComplexArray(const ComplexArray &b) : ComplexArray(b.count) {
+            if (b.block)
+                memcpy(block, b.block, 2 * stride * sizeof(T));
+        }
+
+        ComplexArray(ComplexArray &&b) : block(b.block), count(b.count), stride(b.stride) {
+            b.block = nullptr;
+            b.count = 0;
+            b.stride = 0;
+        }
+
+        ComplexArray() : block(nullptr), count(0), stride(0) { }
+
+        ~ComplexArray() {
+            memory::alignedFree(block);
+        }
+
+        ComplexArray & operator=(ComplexArray b) {
+            std::swap(block, b.block);
+            std::swap(count, b.count);
+            std::swap(stride, b.stride);
+            return *this;
+        }
+
+
+        inline int size() const {
+            return count;
+        }
+
+        inline T* re() { return block; }
+        inline T* im() { return block + stride; }
+        inline const T* re() const { return block; }
+        inline const T* im() const { return block + stride; }
+
+        inline ComplexNumber<T> operator[](int i) const {
+            return ComplexNumber<T>(re()[i], im()[i]);
+        }
+
+        inline void set(int i, const ComplexNumber<T> &c) {
+            re()[i] = c.r;
+            im()[i] = c.i;
+        }
+
+    };
+
+
+    namespace stream {
+
+        // Element-wise kernels over split-complex arrays. The ranges step
+        // by P::lanes, the wrappers below run the bulk with the widest
+        // vectors and the tail with scalars. Outputs may alias inputs.
+        template<typename P, typename T>
+        inline void complexMultiplyRange(const T *ar, const T *ai, const T *br, const T *bi,
+                                         T *outR, T *outI, int begin, int end) {
+            for (int k = begin; k < end; k += P::lanes) {
+                typename P::V xr = P::load(ar + k), xi = P::load(ai + k);
+                typename P::V yr = P::load(br + k), yi = P::load(bi + k);
+                P::store(outR + k, P::sub(P::mul(xr, yr), P::mul(xi, yi)));
+                P::store(outI + k, P::add(P::mul(xr, yi), P::mul(xi, yr)));
+            }
+        }
+
+        // a * conjugate(b)
+        template<typename P, typename T>
+        inline void complexMultiplyConjugateRange(const T *ar, const T *ai, const T *br, const T *bi,
+                                                  T *outR, T *outI, int begin, int end) {
+            for (int k = begin; k < end; k += P::lanes) {
+                typename P::V xr = P::load(ar + k), xi = P::load(ai + k);
+                typename P::V yr = P::load(br + k), yi = P::load(bi + k);
+                P::store(outR + k, P::add(P::mul(xr, yr), P::mul(xi, yi)));
+                P::store(outI + k, P::sub(P::mul(xi, yr), P::mul(xr, yi)));
+            }
+        }
+
+        template<typename P, typename T>
+        inline void complexDivideRange(const T *ar, const T *ai, const T *br, const T *bi,
+                                       T *outR, T *outI, int begin, int end) {
+            for (int k = begin; k < end; k += P::lanes) {
+                typename P::V xr = P::load(ar + k), xi = P::load(ai + k);
+                typename P::V yr = P::load(br + k), yi = P::load(bi + k);
+                typename P::V d = P::add(P::mul(yr, yr), P::mul(yi, yi));
+                P::store(outR + k, P::div(P::add(P::mul(xr, yr), P::mul(xi, yi)), d));
+                P::store(outI + k, P::div(P::sub(P::mul(xi, yr), P::mul(xr, yi)), d));
+            }
+        }
+
+        template<typename P, typename T>
+        inline void complexMagnitudeRange(const T *ar, const T *ai, T *out, int begin, int end) {
+            for (int k = begin; k < end; k += P::lanes) {
+                typename P::V xr = P::load(ar + k), xi = P::load(ai + k);
+                P::store(out + k, P::sqrt(P::add(P::mul(xr, xr), P::mul(xi, xi))));
+            }
+        }
+
+        template<typename P, typename T>
+        inline void complexNormalizeRange(const T *ar, const T *ai, T *outR, T *outI, int begin, int end) {
+            for (int k = begin; k < end; k += P::lanes) {
+                typename P::V xr = P::load(ar + k), xi = P::load(ai + k);
+                typename P::V f = P::div(P::set1(1), P::sqrt(P::add(P::mul(xr, xr), P::mul(xi, xi))));
+                P::store(outR + k, P::mul(xr, f));
+                P::store(outI + k, P::mul(xi, f));
+            }
+        }
+
+        // a * (c + i s), a rotation by a constant angle.
+        template<typename P, typename T>
+        inline void complexRotateRange(const T *ar, const T *ai, T c, T s, T *outR, T *outI, int begin, int end) {
+            typename P::V cr = P::set1(c), ci = P::set1(s);
+            for (int k = begin; k < end; k += P::lanes) {
+                typename P::V xr = P::load(ar + k), xi = P::load(ai + k);
+                P::store(outR + k, P::sub(P::mul(xr, cr), P::mul(xi, ci)));
+                P::store(outI + k, P::add(P::mul(xr, ci), P::mul(xi, cr)));
+            }
+        }
+
+        template<typename T>
+        inline int bulkLength(int n) {
+            return n - n % simd::Lanes<T>::lanes;
+        }
+
+        template<typename T>
+        inline void complexMultiply(const T *ar, const T *ai, const T *br, const T *bi, T *outR, T *outI, int n) {
+            complexMultiplyRange<simd::Lanes<T>>(ar, ai, br, bi, outR, outI, 0, bulkLength<T>(n));
+            complexMultiplyRange<simd::Scalar<T>>(ar, ai, br, bi, outR, outI, bulkLength<T>(n), n);
+        }
+
+        template<typename T>
+        inline void complexMultiplyConjugate(const T *ar, const T *ai, const T *br, const T *bi, T *outR, T *outI, int n) {
+            complexMultiplyConjugateRange<simd::Lanes<T>>(ar, ai, br, bi, outR, outI, 0, bulkLength<T>(n));
+            complexMultiplyConjugateRange<simd::Scalar<T>>(ar, ai, br, bi, outR, outI, bulkLength<T>(n), n);
+        }
+
+        template<typename T>
+        inline void complexDivide(const T *ar, const T *ai, const T *br, const T *bi, T *outR, T *outI, int n) {
+            complexDivideRange<simd::Lanes<T>>(ar, ai, br, bi, outR, outI, 0, bulkLength<T>(n));
+            complexDivideRange<simd::Scalar<T>>(ar, ai, br, bi, outR, outI, bulkLength<T>(n), n);
+        }
+
+        template<typename T>
+        inline void complexMagnitude(const T *ar, const T *ai, T *out, int n) {
+            complexMagnitudeRange<simd::Lanes<T>>(ar, ai, out, 0, bulkLength<T>(n));
+            complexMagnitudeRange<simd::Scalar<T>>(ar, ai, out, bulkLength<T>(n), n);
+        }
+
+        template<typename T>
+        inline void complexNormalize(const T *ar, const T *ai, T *outR, T *outI, int n) {
+            complexNormalizeRange<simd::Lanes<T>>(ar, ai, outR, outI, 0, bulkLength<T>(n));
+            complexNormalizeRange<simd::Scalar<T>>(ar, ai, outR, outI, bulkLength<T>(n), n);
+        }
+
+        template<typename T>
+        inline void complexRotate(const T *ar, const T *ai, T angle, T *outR, T *outI, int n) {
+            T s, c;
+            trig::sincos(angle, s, c);
+            complexRotateRange<simd::Lanes<T>>(ar, ai, c, s, outR, outI, 0, bulkLength<T>(n));
+            complexRotateRange<simd::Scalar<T>>(ar, ai, c, s, outR, outI, bulkLength<T>(n), n);
+        }
+
+        // Per element angles, through the batch sincos in blocks that stay
+        // in L1.
+        template<typename T, typename P>
+        inline void complexRotate(const T *ar, const T *ai, const T *angles, T *outR, T *outI, int n, P precision) {
+            const int block = 256;
+            T s[block], c[block];
+            for (int first = 0; first < n; first += block) {
+                int length = n - first < block ? n - first : block;
+                trig::sincos(angles + first, s, c, length, precision);
+                complexMultiply(ar + first, ai + first, c, s, outR + first, outI + first, length);
+            }
+        }
+
+    }
+
+
+    // Element-wise operations on whole ComplexArrays, matching the
+    // ComplexNumber operators. 'out' may be one of the inputs. Arrays of
+    // different sizes are processed up to the smallest of them, the rest
+    // of 'out' is left as it was.
+    template<typename T>
+    inline int commonSize(const ComplexArray<T> &a, const ComplexArray<T> &b) {
+        return a.size() < b.size() ? a.size() : b.size();
+    }
+
+    template<typename T>
+    inline int commonSize(const ComplexArray<T> &a, const ComplexArray<T> &b, const ComplexArray<T> &c) {
+        int n = commonSize(a, b);
+        return n < c.size() ? n : c.size();
+    }
+
+    template<typename T>
+    inline void multiply(const ComplexArray<T> &a, const ComplexArray<T> &b, ComplexArray<T> &out) {
+        stream::complexMultiply(a.re(), a.im(), b.re(), b.im(), out.re(), out.im(), commonSize(a, b, out));
+    }
+
+    // a * conjugate(b), the correlation kernel.
+    template<typename T>
+    inline void multiplyConjugate(const ComplexArray<T> &a, const ComplexArray<T> &b, ComplexArray<T> &out) {
+        stream::complexMultiplyConjugate(a.re(), a.im(), b.re(), b.im(), out.re(), out.im(), commonSize(a, b, out));
+    }
+
+    template<typename T>
+    inline void divide(const ComplexArray<T> &a, const ComplexArray<T> &b, ComplexArray<T> &out) {
+        stream::complexDivide(a.re(), a.im(), b.re(), b.im(), out.re(), out.im(), commonSize(a, b, out));
+    }
+
+    // 'out' needs room for a.size() elements.
+    template<typename T>
+    inline void magnitude(const ComplexArray<T> &a, T *out) {
+        stream::complexMagnitude(a.re(), a.im(), out, a.size());
+    }
+
+    template<typename T>
+    inline void normalize(const ComplexArray<T> &a, ComplexArray<T> &out) {
+        stream::complexNormalize(a.re(), a.im(), out.re(), out.im(), commonSize(a, out));
+    }
+
+    // Rotates every element by 'angle' radians.
+    template<typename T>
+    inline void rotate(const ComplexArray<T> &a, T angle, ComplexArray<T> &out) {
+        stream::complexRotate(a.re(), a.im(), angle, out.re(), out.im(), commonSize(a, out));
+    }
+
+    // Rotates element i by angles[i], with the precision of the batch sincos.
+    // 'angles' needs as many elements as are rotated.
+    template<typename T, typename P = trig::Fast>
+    inline void rotate(const ComplexArray<T> &a, const T *angles, ComplexArray<T> &out, P precision = P()) {
+        stream::complexRotate(a.re(), a.im(), angles, out.re(), out.im(), commonSize(a, out), precision);
+    }
+
+
+    // Building blocks of FFTPlan. Stages follow the Stockham autosort
+    // scheme: each one reads one buffer and writes the other in order, so
+    // there's no bit reversal pass, and the innermost loop runs over
+    // contiguous elements that share their twiddle factors.
+    namespace fft {
+
+        // (r, i) *= (wr, wi)
+        template<typename P>
+        inline void rotate(typename P::V &r, typename P::V &i, typename P::V wr, typename P::V wi) {
+            typename P::V t = P::sub(P::mul(r, wr), P::mul(i, wi));
+            i = P::add(P::mul(r, wi), P::mul(i, wr));
+            r = t;
+        }
+
+        // Forward DFTs of R values in place, outputs in natural order.
+        // dft4 reads every s-th value so that dft8 can split into halves.
+        template<typename P>
+        inline void dft2(typename P::V *r, typename P::V *i) {
+            typename P::V tr = r[1], ti = i[1];
+            r[1] = P::sub(r[0], tr);
+            i[1] = P::sub(i[0], ti);
+            r[0] = P::add(r[0], tr);
+            i[0] = P::add(i[0], ti);
+        }
+
+        template<typename P>
+        inline void dft4(typename P::V *r, typename P::V *i, int s) {
+            typedef typename P::V V;
+            V t0r = P::add(r[0], r[2 * s]), t0i = P::add(i[0], i[2 * s]);
+            V t1r = P::sub(r[0], r[2 * s]), t1i = P::sub(i[0], i[2 * s]);
+            V t2r = P::add(r[s], r[3 * s]), t2i = P::add(i[s], i[3 * s]);
+            V t3r = P::sub(r[s], r[3 * s]), t3i = P::sub(i[s], i[3 * s]);
+            r[0] = P::add(t0r, t2r);
+            i[0] = P::add(t0i, t2i);
+            r[2 * s] = P::sub(t0r, t2r);
+            i[2 * s] = P::sub(t0i, t2i);
+            // t1 - i * t3 and t1 + i * t3
+            r[s] = P::add(t1r, t3i);
+            i[s] = P::sub(t1i, t3r);
+            r[3 * s] = P::sub(t1r, t3i);
+            i[3 * s] = P::add(t1i, t3r);
+        }
+
+        // Two DFT4s of the even and odd values, combined with w8^k.
+        template<typename P>
+        inline void dft8(typename P::V *r, typename P::V *i) {
+            typedef typename P::V V;
+            dft4<P>(r, i, 2);
+            dft4<P>(r + 1, i + 1, 2);
+            V h = P::set1(typename P::Element(0.70710678118654752440));
+
+            // w8 = (1 - i) / sqrt(2), w8^3 = (-1 - i) / sqrt(2), w8^2 = -i
+            V o1r = P::mul(P::add(r[3], i[3]), h), o1i = P::mul(P::sub(i[3], r[3]), h);
+            V o3r = P::mul(P::sub(i[7], r[7]), h), o3n = P::mul(P::add(r[7], i[7]), h);
+
+            V e0r = r[0], e0i = i[0], o0r = r[1], o0i = i[1];
+            V e1r = r[2], e1i = i[2];
+            V e2r = r[4], e2i = i[4], o2r = r[5], o2i = i[5];
+            V e3r = r[6], e3i = i[6];
+
+            r[0] = P::add(e0r, o0r); i[0] = P::add(e0i, o0i);
+            r[4] = P::sub(e0r, o0r); i[4] = P::sub(e0i, o0i);
+            r[1] = P::add(e1r, o1r); i[1] = P::add(e1i, o1i);
+            r[5] = P::sub(e1r, o1r); i[5] = P::sub(e1i, o1i);
+            r[2] = P::add(e2r, o2i); i[2] = P::sub(e2i, o2r);
+            r[6] = P::sub(e2r, o2i); i[6] = P::add(e2i, o2r);
+            r[3] = P::add(e3r, o3r); i[3] = P::sub(e3i, o3n);
+            r[7] = P::sub(e3r, o3r); i[7] = P::add(e3i, o3n);
+        }
+
+        template<typename P, int R>
+        inline void dft(typename P::V *r, typename P::V *i) {
+            if (R == 2)
+                dft2<P>(r, i);
+            else if (R == 4)
+                dft4<P>(r, i, 1);
+            else
+                dft8<P>(r, i);
+        }
+
+        // One radix R stage over sequences of length R * m interleaved with
+        // stride s, x[q + s * (j + t * m)] -> y[q + s * (R * j + u)], where
+        // output u is multiplied by the twiddle w^(j * u) from (wr, wi),
+        // stored as [(u - 1) * m + j]. Lanes run along q, s is a multiple of
+        // their count.
+        template<typename P, int R, typename T>
+        void stageColumns(int m, int s, const T *xr, const T *xi, T *yr, T *yi, const T *wr, const T *wi) {
+            typedef typename P::V V;
+            for (int j = 0; j < m; j++) {
+                V twr[R], twi[R];
+                for (int u = 1; u < R; u++) {
+                    twr[u] = P::set1(wr[(u - 1) * m + j]);
+                    twi[u] = P::set1(wi[(u - 1) * m + j]);
+                }
+                for (int q = 0; q < s; q += P::lanes) {
+                    V r[R], i[R];
+                    for (int t = 0; t < R; t++) {
+                        r[t] = P::load(xr + q + s * (j + t * m));
+                        i[t] = P::load(xi + q + s * (j + t * m));
+                    }
+                    dft<P, R>(r, i);
+                    for (int u = 1; u < R; u++)
+                        rotate<P>(r[u], i[u], twr[u], twi[u]);
+                    for (int u = 0; u < R; u++) {
+                        P::store(yr + q + s * (R * j + u), r[u]);
+                        P::store(yi + q + s * (R * j + u), i[u]);
+                    }
+                }
+            }
+        }
+
+        // The first stage, s = 1, with lanes along j instead. Each group of
+        // lanes x lanes outputs is transposed so that the stores stay
+        // contiguous, which needs R and m to be multiples of the lane count.
+        template<typename P, int R, typename T>
+        void stageRows(int m, const T *xr, const T *xi, T *yr, T *yi, const T *wr, const T *wi) {
+            typedef typename P::V V;
+            if (R % P::lanes != 0)
+                return;
+            for (int j = 0; j < m; j += P::lanes) {
+                V r[R], i[R];
+                for (int t = 0; t < R; t++) {
+                    r[t] = P::load(xr + j + t * m);
+                    i[t] = P::load(xi + j + t * m);
+                }
+                dft<P, R>(r, i);
+                for (int u = 1; u < R; u++)
+                    rotate<P>(r[u], i[u], P::load(wr + (u - 1) * m + j), P::load(wi + (u - 1) * m + j));
+                for (int g = 0; g < R; g += P::lanes) {
+                    P::transpose(r + g);
+                    P::transpose(i + g);
+                    for (int l = 0; l < P::lanes; l++) {
+                        P::store(yr + R * (j + l) + g, r[g + l]);
+                        P::store(yi + R * (j + l) + g, i[g + l]);
+                    }
+                }
+            }
+        }
+
+        // Any other radix p as a direct DFT with the roots w_p^k in
+        // (rootR, rootI), O(p) per output.
+        template<typename P, typename T>
+        void stageGeneric(int p, int m, int s, const T *xr, const T *xi, T *yr, T *yi,
+                          const T *wr, const T *wi, const T *rootR, const T *rootI) {
+            typedef typename P::V V;
+            for (int j = 0; j < m; j++) {
+                for (int q = 0; q < s; q += P::lanes) {
+                    for (int u = 0; u < p; u++) {
+                        V sr = P::set1(0), si = P::set1(0);
+                        for (int t = 0, k = 0; t < p; t++, k = (k + u) % p) {
+                            V ar = P::load(xr + q + s * (j + t * m));
+                            V ai = P::load(xi + q + s * (j + t * m));
+                            V cr = P::set1(rootR[k]), ci = P::set1(rootI[k]);
+                            sr = P::add(sr, P::sub(P::mul(ar, cr), P::mul(ai, ci)));
+                            si = P::add(si, P::add(P::mul(ar, ci), P::mul(ai, cr)));
+                        }
+                        if (u > 0)
+                            rotate<P>(sr, si, P::set1(wr[(u - 1) * m + j]), P::set1(wi[(u - 1) * m + j]));
+                        P::store(yr + q + s * (p * j + u), sr);
+                        P::store(yi + q + s * (p * j + u), si);
+                    }
+                }
+            }
+        }
+
+    }
+
+
+    // Precomputed FFT of a fixed size n, 1 <= n <= maxCount, on split-complex
+    // arrays or arrays of ComplexNumber. n is split into radix 8, 4 and 2
+    // stages followed by its odd prime factors, which are handled by a
+    // direct DFT, so sizes with large prime factors cost O(n * p). Plans own
+    // scratch buffers, use one per thread. Other sizes throw
+    // std::invalid_argument.
+    template<typename T>
+    class FFTPlan {
+
+    protected:
+
+        struct Stage {
+            int radix;
+            int twiddles;
+            int roots;
+        };
+
+        T *block;
+        int count;
+        int stride;
+        int stageCount;
+        int tableSize;
+        Stage stages[32];
+
+        static int paddedLength(int n) {
+            const int lanes = alignment / sizeof(T);
+            return (n + lanes - 1) / lanes * lanes;
+        }
+
+        T *scratch(int i) { return block + i * stride; }
+        const T *twiddleR() const { return block + 4 * stride; }
+        const T *twiddleI() const { return block + 4 * stride + tableSize; }
+
+        // Largest radices first, so that the first stage, the only one with
+        // stride 1, can still use full vectors.
+        void factorize() {
+            int n = count, twos = 0;
+            while (n % 2 == 0) {
+                n /= 2;
+                twos++;
+            }
+            stageCount = 0;
+            for (; twos >= 3; twos -= 3)
+                stages[stageCount++].radix = 8;
+            if (twos > 0)
+                stages[stageCount++].radix = 1 << twos;
+            for (int p = 3; n > 1; p += 2) {
+                if (p > n / p)
+                    p = n;
+                while (n % p == 0) {
+                    stages[stageCount++].radix = p;
+                    n /= p;
+                }
+            }
+        }
+
+        // Stage k with stride s works on sequences of length n / s, its
+        // twiddles are w^(j * u) with w = exp(-2 pi i s / n).
+        void computeTables() {
+            tableSize = 0;
+            for (int k = 0, s = 1; k < stageCount; s *= stages[k].radix, k++) {
+                int p = stages[k].radix, m = count / s / p;
+                stages[k].twiddles = tableSize;
+                tableSize += (p - 1) * m;
+                stages[k].roots = tableSize;
+                tableSize += p;
+            }
+            block = (T*)memory::alignedAlloc((4 * stride + 2 * tableSize) * sizeof(T), alignment);
+            if (!block)
+                throw std::bad_alloc();
+
+            T *re = block + 4 * stride, *im = re + tableSize;
+            for (int k = 0, s = 1; k < stageCount; s *= stages[k].radix, k++) {
+                int p = stages[k].radix, length = count / s, m = length / p;
+                for (int u = 1; u < p; u++) {
+                    for (int j = 0; j < m; j++) {
+                        double a = -2 * constant::pi * ((long long)j * u % length) / length;
+                        re[stages[k].twiddles + (u - 1) * m + j] = T(::cos(a));
+                        im[stages[k].twiddles + (u - 1) * m + j] = T(::sin(a));
+                    }
+                }
+                for (int u = 0; u < p; u++) {
+                    double a = -2 * constant::pi * u / p;
+                    re[stages[k].roots + u] = T(::cos(a));
+                    im[stages[k].roots + u] = T(::sin(a));
+                }
+            }
+        }
+
+        template<typename P>
+        void columns(const Stage &stage, int m, int s, const T *xr, const T *xi, T *yr, T *yi) const {
+            const T *wr = twiddleR() + stage.twiddles, *wi = twiddleI() + stage.twiddles;
+            switch (stage.radix) {
+                case 2: fft::stageColumns<P, 2>(m, s, xr, xi, yr, yi, wr, wi); break;
+                case 4: fft::stageColumns<P, 4>(m, s, xr, xi, yr, yi, wr, wi); break;
+                case 8: fft::stageColumns<P, 8>(m, s, xr, xi, yr, yi, wr, wi); break;
+                default:
+                    fft::stageGeneric<P>(stage.radix, m, s, xr, xi, yr, yi, wr, wi,
+                                         twiddleR() + stage.roots, twiddleI() + stage.roots);
+            }
+        }
+
+        void rows(const Stage &stage, int m, const T *xr, const T *xi, T *yr, T *yi) const {
+            typedef simd::Lanes<T> P;
+            const T *wr = twiddleR() + stage.twiddles, *wi = twiddleI() + stage.twiddles;
+            switch (stage.radix) {
+                case 2: fft::stageRows<P, 2>(m, xr, xi, yr, yi, wr, wi); break;
+                case 4: fft::stageRows<P, 4>(m, xr, xi, yr, yi, wr, wi); break;
+                default: fft::stageRows<P, 8>(m, xr, xi, yr, yi, wr, wi); break;
+            }
+        }
+
+        // Forward transform of (re, im), ping-ponging with scratch pair 'k'.
+        void run(T *re, T *im, int k) {
+            const int lanes = simd::Lanes<T>::lanes;
+            T *xr = re, *xi = im, *yr = scratch(k), *yi = scratch(k + 1);
+            for (int i = 0, s = 1; i < stageCount; s *= stages[i].radix, i++) {
+                const Stage &stage = stages[i];
+                int m = count / s / stage.radix;
+                if (s % lanes == 0)
+                    columns<simd::Lanes<T>>(stage, m, s, xr, xi, yr, yi);
+                else if (s == 1 && stage.radix <= 8 && stage.radix % lanes == 0 && m % lanes == 0)
+                    rows(stage, m, xr, xi, yr, yi);
+                else
+                    columns<simd::Scalar<T>>(stage, m, s, xr, xi, yr, yi);
+                std::swap(xr, yr);
+                std::swap(xi, yi);
+            }
+            if (xr != re) {
+                memcpy(re, xr, count * sizeof(T));
+                memcpy(im, xi, count * sizeof(T));
+            }
+        }
+
+    public:
+
+        static const int alignment = 32;
+
+        // Scratch and tables take about 8n elements, indexed with int.
+        static const int maxCount = 1 << 27;
+
+        explicit FFTPlan(int count) : count(count) {
+            if (count < 1 || count > maxCount)
+                throw std::invalid_argument("FFTPlan size out of range");
+            stride = paddedLength(count);
+            factorize();
+            computeTables();
+        }
+
+        FFTPlan(const FFTPlan &b) : FFTPlan(b.count) { }
+
+        FFTPlan(FFTPlan &&b) : block(b.block), count(b.count), stride(b.stride),
+                               stageCount(b.stageCount), tableSize(b.tableSize) {
+            memcpy(stages, b.stages, sizeof(stages));
+            b.block = nullptr;
+        }
+
+        ~FFTPlan() {
+            memory::alignedFree(block);
+        }
+
+        FFTPlan & operator=(FFTPlan b) {
+            std::swap(block, b.block);
+            std::swap(count, b.count);
+            std::swap(stride, b.stride);
+            std::swap(stageCount, b.stageCount);
+            std::swap(tableSize, b.tableSize);
+            std::swap(stages, b.stages);
+            return *this;
+        }
+
+
+        inline int size() const {
+            return count;
+        }
+
+        // X[k] = sum of x[j] * exp(-2 pi i j k / n), in place.
+        void forward(T *re, T *im) {
+            run(re, im, 0);
+        }
+
+        // Scaled by 1 / n, so that it undoes forward(). Swapping the real
+        // and imaginary parts turns the forward transform into the inverse.
+        void inverse(T *re, T *im) {
+            run(im, re, 0);
+            T scale = T(1) / count;
+            for (int i = 0; i < count; i++) {
+                re[i] *= scale;
+                im[i] *= scale;
+            }
+        }
+
+        void forward(ComplexArray<T> &data) {
+            forward(data.re(), data.im());
+        }
+
+        void inverse(ComplexArray<T> &data) {
+            inverse(data.re(), data.im());
+        }
+
+        void forward(ComplexNumber<T> *data) {
+            T *re = scratch(2), *im = scratch(3);
+            for (int i = 0; i < count; i++) {
+                re[i] = data[i].r;
+                im[i] = data[i].i;
+            }
+            run(re, im, 0);
+            for (int i = 0; i < count; i++)
+                data[i] = ComplexNumber<T>(re[i], im[i]);
+        }
+
+        void inverse(ComplexNumber<T> *data) {
+            T *re = scratch(2), *im = scratch(3);
+            for (int i = 0; i < count; i++) {
+                re[i] = data[i].r;
+                im[i] = data[i].i;
+            }
+            run(im, re, 0);
+            T scale = T(1) / count;
+            for (int i = 0; i < count; i++)
+                data[i] = ComplexNumber<T>(re[i] * scale, im[i] * scale);
+        }
+
+    };
+
+
+    // Compact element types for vertex, instance and asset data. They
+    // only store values, arithmetic converts to float and back, so use
+    // them for Vector and Matrix storage and unpack to float for math.
+
+    // IEEE 754 binary16. Conversions round to nearest even and keep
+    // denormals, infinities and NaN.
+    class half {
+
+    public:
+
+        uint16_t bits;
+
+        half() = default;
+
+        half(float f) : bits(fromFloat(f)) { }
+
+        operator float() const {
+            return toFloat(bits);
+        }
+
+        static half fromBits(uint16_t bits) {
+            half h;
+            h.bits = bits;
+            return h;
+        }
+
+        half & operator+=(float b) { return *this = float(*this) + b; }
+        half & operator-=(float b) { return *this = float(*this) - b; }
+        half & operator*=(float b) { return *this = float(*this) * b; }
+        half & operator/=(float b) { return *this = float(*this) / b; }
+
+        static uint16_t fromFloat(float f) {
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            uint32_t sign = u & 0x80000000u;
+            u ^= sign;
+
+            uint32_t o;
+            if (u >= (127 + 16) << 23) {
+                // Too big for half, or already infinite or NaN.
+                o = u > 0x7f800000u ? 0x7e00 : 0x7c00;
+            } else if (u < 113 << 23) {
+                // Denormal or zero, adding the magic number lets the FPU
+                // shift the mantissa into place and round it.
+                const uint32_t magicBits = (127 - 15 + 23 - 10 + 1) << 23;
+                float magic, sum;
+                memcpy(&magic, &magicBits, 4);
+                memcpy(&sum, &u, 4);
+                sum += magic;
+                memcpy(&o, &sum, 4);
+                o -= magicBits;
+            } else {
+                uint32_t odd = (u >> 13) & 1;
+                u += 0xfff + odd - ((127 - 15) << 23);
+                o = u >> 13;
+            }
+            return uint16_t(o | (sign >> 16));
+        }
+
+        static float toFloat(uint16_t h) {
+            const uint32_t shiftedExponent = 0x7c00 << 13;
+            uint32_t o = (h & 0x7fffu) << 13;
+            uint32_t exponent = o & shiftedExponent;
+            o += (127 - 15) << 23;
+
+            if (exponent == shiftedExponent) {
+                o += (128 - 16) << 23;
+            } else if (exponent == 0) {
+                // Denormal, renormalize by subtracting the implicit one.
+                const uint32_t magicBits = 113 << 23;
+                float magic, value;
+                o += 1 << 23;
+                memcpy(&magic, &magicBits, 4);
+                memcpy(&value, &o, 4);
+                value -= magic;
+                memcpy(&o, &value, 4);
+            }
+            o |= uint32_t(h & 0x8000) << 16;
+
+            float f;
+            memcpy(&f, &o, 4);
+            return f;
+        }
+
+    };
+
+
+    namespace normalized {
+
+        // Clamps like _mm_max_ps/_mm_min_ps, so NaN ends up as 'low'.
+        inline float clamp(float f, float low, float high) {
+            f = f > low ? f : low;
+            return f < high ? f : high;
+        }
+
+        // Rounds to nearest even, like _mm_cvtps_epi32.
+        inline int quantize(float f, float low, float high, float scale) {
+            return (int)lrintf(clamp(f, low, high) * scale);
+        }
+
+    }
+
+
+    // Signed 16-bit normalized, [-1, 1] in steps of 1/32767, as read by
+    // GL_SHORT and VK_FORMAT_R16_SNORM attributes.
+    class snorm16 {
+
+    public:
+
+        int16_t bits;
+
+        snorm16() = default;
+
+        snorm16(float f) : bits(int16_t(normalized::quantize(f, -1.f, 1.f, 32767.f))) { }
+
+        operator float() const {
+            float f = bits * (1.f / 32767.f);
+            return f > -1.f ? f : -1.f;
+        }
+
+        snorm16 & operator+=(float b) { return *this = float(*this) + b; }
+        snorm16 & operator-=(float b) { return *this = float(*this) - b; }
+        snorm16 & operator*=(float b) { return *this = float(*this) * b; }
+        snorm16 & operator/=(float b) { return *this = float(*this) / b; }
+
+    };
+
+
+    // Unsigned 8-bit normalized, [0, 1] in steps of 1/255, for colors and
+    // weights.
+    class unorm8 {
+
+    public:
+
+        uint8_t bits;
+
+        unorm8() = default;
+
+        unorm8(float f) : bits(uint8_t(normalized::quantize(f, 0.f, 1.f, 255.f))) { }
+
+        operator float() const {
+            return bits * (1.f / 255.f);
+        }
+
+        unorm8 & operator+=(float b) { return *this = float(*this) + b; }
+        unorm8 & operator-=(float b) { return *this = float(*this) - b; }
+        unorm8 & operator*=(float b) { return *this = float(*this) * b; }
+        unorm8 & operator/=(float b) { return *this = float(*this) / b; }
+
+    };
+
+
+    // Four components in one 32-bit word, x in the low 10 bits and w in
+    // the top 2, the layout of GL_UNSIGNED_INT_2_10_10_10_REV and
+    // VK_FORMAT_A2B10G10R10_UNORM_PACK32.
+    class unorm10_10_10_2 {
+
+    public:
+
+        uint32_t bits;
+
+        unorm10_10_10_2() = default;
+
+        unorm10_10_10_2(const Vector<4, float> &v) {
+            bits = uint32_t(normalized::quantize(v[0], 0.f, 1.f, 1023.f))
+                 | uint32_t(normalized::quantize(v[1], 0.f, 1.f, 1023.f)) << 10
+                 | uint32_t(normalized::quantize(v[2], 0.f, 1.f, 1023.f)) << 20
+                 | uint32_t(normalized::quantize(v[3], 0.f, 1.f, 3.f)) << 30;
+        }
+
+        operator Vector<4, float>() const {
+            return Vector<4, float>(
+                (bits & 0x3ff) * (1.f / 1023.f),
+                ((bits >> 10) & 0x3ff) * (1.f / 1023.f),
+                ((bits >> 20) & 0x3ff) * (1.f / 1023.f),
+                (bits >> 30) * (1.f / 3.f)
+            );
+        }
+
+    };
+
+
+    // Signed counterpart for normals and tangents, GL_INT_2_10_10_10_REV
+    // and VK_FORMAT_A2B10G10R10_SNORM_PACK32. w holds -1, 0 or 1, enough
+    // for a bitangent sign.
+    class snorm10_10_10_2 {
+
+    protected:
+
+        static float component(int32_t c, float scale) {
+            float f = c * scale;
+            return f > -1.f ? f : -1.f;
+        }
+
+    public:
+
+        uint32_t bits;
+
+        snorm10_10_10_2() = default;
+
+        snorm10_10_10_2(const Vector<4, float> &v) {
+            bits = (uint32_t(normalized::quantize(v[0], -1.f, 1.f, 511.f)) & 0x3ff)
+                 | (uint32_t(normalized::quantize(v[1], -1.f, 1.f, 511.f)) & 0x3ff) << 10
+                 | (uint32_t(normalized::quantize(v[2], -1.f, 1.f, 511.f)) & 0x3ff) << 20
+                 | uint32_t(normalized::quantize(v[3], -1.f, 1.f, 1.f)) << 30;
+        }
+
+        operator Vector<4, float>() const {
+            // Shifting the field to the top and back sign-extends it.
+            int32_t b = (int32_t)bits;
+            return Vector<4, float>(
+                component(int32_t(uint32_t(b) << 22) >> 22, 1.f / 511.f),
+                component(int32_t(uint32_t(b) << 12) >> 22, 1.f / 511.f),
+                component(int32_t(uint32_t(b) << 2) >> 22, 1.f / 511.f),
+                component(b >> 30, 1.f)
+            );
+        }
+
+    };
+
+
+#ifdef ENG_MATH_SSE
+
+    namespace simd {
+
+        // The half conversions above on four lanes, the halves sit in
+        // the low 16 bits of each 32-bit lane.
+        inline __m128i floatToHalf(__m128 x) {
+            __m128i u = _mm_castps_si128(x);
+            __m128i sign = _mm_and_si128(u, _mm_set1_epi32((int)0x80000000u));
+            u = _mm_xor_si128(u, sign);
+
+            __m128i overflow = _mm_cmpgt_epi32(u, _mm_set1_epi32(((127 + 16) << 23) - 1));
+            __m128i nan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f800000));
+            __m128i infinite = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(nan, _mm_set1_epi32(0x0200)));
+
+            const __m128i magicBits = _mm_set1_epi32((127 - 15 + 23 - 10 + 1) << 23);
+            __m128 sum = _mm_add_ps(_mm_castsi128_ps(u), _mm_castsi128_ps(magicBits));
+            __m128i small = _mm_sub_epi32(_mm_castps_si128(sum), magicBits);
+
+            __m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+            __m128i rounded = _mm_add_epi32(u, _mm_set1_epi32(0xfff - ((127 - 15) << 23)));
+            __m128i normal = _mm_srli_epi32(_mm_add_epi32(rounded, odd), 13);
+
+            __m128i isSmall = _mm_cmplt_epi32(u, _mm_set1_epi32(113 << 23));
+            __m128i o = _mm_or_si128(_mm_and_si128(isSmall, small), _mm_andnot_si128(isSmall, normal));
+            o = _mm_or_si128(_mm_and_si128(overflow, infinite), _mm_andnot_si128(overflow, o));
+            return _mm_or_si128(o, _mm_srli_epi32(sign, 16));
+        }
+
+        inline __m128 halfToFloat(__m128i h) {
+            const __m128i shiftedExponent = _mm_set1_epi32(0x7c00 << 13);
+            __m128i o = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+            __m128i exponent = _mm_and_si128(o, shiftedExponent);
+            o = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+
+            __m128i special = _mm_cmpeq_epi32(exponent, shiftedExponent);
+            o = _mm_add_epi32(o, _mm_and_si128(special, _mm_set1_epi32((128 - 16) << 23)));
+
+            __m128i denormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+            __m128 renormalized = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(o, _mm_set1_epi32(1 << 23))),
+                                             _mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+            o = _mm_or_si128(_mm_and_si128(denormal, _mm_castps_si128(renormalized)), _mm_andnot_si128(denormal, o));
+
+            __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+            return _mm_castsi128_ps(_mm_or_si128(o, sign));
+        }
+
+        // Narrows 32-bit lanes holding 16-bit values, packs_epi32 alone
+        // would saturate the ones with the top bit set.
+        inline __m128i narrow16(__m128i a, __m128i b) {
+            a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            return _mm_packs_epi32(a, b);
+        }
+
+        inline __m128 clamp(__m128 x, float low, float high) {
+            return _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(low)), _mm_set1_ps(high));
+        }
+
+    }
+
+#endif
+
+
+    namespace stream {
+
+        // Bulk conversions between float arrays and the compact types.
+        // 'n' counts elements, the 10_10_10_2 ones read and write four
+        // floats per element. Results match the scalar constructors and
+        // conversion operators, except for NaN payloads with F16C.
+
+        inline void pack(const float *in, half *out, int n) {
+            int i = 0;
+#if defined(ENG_MATH_F16C)
+            for (; i + 8 <= n; i += 8)
+                _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(ENG_MATH_SSE)
+            for (; i + 8 <= n; i += 8) {
+                __m128i a = simd::floatToHalf(_mm_loadu_ps(in + i));
+                __m128i b = simd::floatToHalf(_mm_loadu_ps(in + i + 4));
+                _mm_storeu_si128((__m128i*)(out + i), simd::narrow16(a, b));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = half(in[i]);
+        }
+
+        inline void unpack(const half *in, float *out, int n) {
+            int i = 0;
+#if defined(ENG_MATH_F16C)
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+#elif defined(ENG_MATH_SSE)
+            for (; i + 8 <= n; i += 8) {
+                __m128i h = _mm_loadu_si128((const __m128i*)(in + i));
+                _mm_storeu_ps(out + i, simd::halfToFloat(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+                _mm_storeu_ps(out + i + 4, simd::halfToFloat(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = in[i];
+        }
+
+        inline void pack(const float *in, snorm16 *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128 scale = _mm_set1_ps(32767.f);
+            for (; i + 8 <= n; i += 8) {
+                __m128i a = _mm_cvtps_epi32(_mm_mul_ps(simd::clamp(_mm_loadu_ps(in + i), -1.f, 1.f), scale));
+                __m128i b = _mm_cvtps_epi32(_mm_mul_ps(simd::clamp(_mm_loadu_ps(in + i + 4), -1.f, 1.f), scale));
+                _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = snorm16(in[i]);
+        }
+
+        inline void unpack(const snorm16 *in, float *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128 scale = _mm_set1_ps(1.f / 32767.f), low = _mm_set1_ps(-1.f);
+            for (; i + 8 <= n; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+                __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                _mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), low));
+                _mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), scale), low));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = in[i];
+        }
+
+        inline void pack(const float *in, unorm8 *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128 scale = _mm_set1_ps(255.f);
+            for (; i + 16 <= n; i += 16) {
+                __m128i v[4];
+                for (int k = 0; k < 4; k++)
+                    v[k] = _mm_cvtps_epi32(_mm_mul_ps(simd::clamp(_mm_loadu_ps(in + i + 4 * k), 0.f, 1.f), scale));
+                __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+                _mm_storeu_si128((__m128i*)(out + i), packed);
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = unorm8(in[i]);
+        }
+
+        inline void unpack(const unorm8 *in, float *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128 scale = _mm_set1_ps(1.f / 255.f);
+            const __m128i zero = _mm_setzero_si128();
+            for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+                __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+                __m128i w[4] = {
+                    _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                    _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+                };
+                for (int k = 0; k < 4; k++)
+                    _mm_storeu_ps(out + i + 4 * k, _mm_mul_ps(_mm_cvtepi32_ps(w[k]), scale));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = in[i];
+        }
+
+        inline void pack(const float *in, unorm10_10_10_2 *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128 scale = _mm_set1_ps(1023.f);
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps(in + 4 * i), y = _mm_loadu_ps(in + 4 * i + 4);
+                __m128 z = _mm_loadu_ps(in + 4 * i + 8), w = _mm_loadu_ps(in + 4 * i + 12);
+                _MM_TRANSPOSE4_PS(x, y, z, w);
+                __m128i packed = _mm_cvtps_epi32(_mm_mul_ps(simd::clamp(x, 0.f, 1.f), scale));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(simd::clamp(y, 0.f, 1.f), scale)), 10));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(simd::clamp(z, 0.f, 1.f), scale)), 20));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(simd::clamp(w, 0.f, 1.f), _mm_set1_ps(3.f))), 30));
+                _mm_storeu_si128((__m128i*)(out + i), packed);
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = unorm10_10_10_2(Vector<4, float>(in[4 * i], in[4 * i + 1], in[4 * i + 2], in[4 * i + 3]));
+        }
+
+        inline void unpack(const unorm10_10_10_2 *in, float *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128i mask = _mm_set1_epi32(0x3ff);
+            const __m128 scale = _mm_set1_ps(1.f / 1023.f);
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+                __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(v, mask)), scale);
+                __m128 y = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 10), mask)), scale);
+                __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 20), mask)), scale);
+                __m128 w = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(v, 30)), _mm_set1_ps(1.f / 3.f));
+                _MM_TRANSPOSE4_PS(x, y, z, w);
+                _mm_storeu_ps(out + 4 * i, x);
+                _mm_storeu_ps(out + 4 * i + 4, y);
+                _mm_storeu_ps(out + 4 * i + 8, z);
+                _mm_storeu_ps(out + 4 * i + 12, w);
+            }
+#endif
+            for (; i < n; i++) {
+                Vector<4, float> v = in[i];
+                for (int k = 0; k < 4; k++)
+                    out[4 * i + k] = v[k];
+            }
+        }
+
+        inline void pack(const float *in, snorm10_10_10_2 *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128i mask = _mm_set1_epi32(0x3ff);
+            const __m128 scale = _mm_set1_ps(511.f);
+            for (; i + 4 <= n; i += 4) {
+                __m128 x = _mm_loadu_ps(in + 4 * i), y = _mm_loadu_ps(in + 4 * i + 4);
+                __m128 z = _mm_loadu_ps(in + 4 * i + 8), w = _mm_loadu_ps(in + 4 * i + 12);
+                _MM_TRANSPOSE4_PS(x, y, z, w);
+                __m128i cx = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(simd::clamp(x, -1.f, 1.f), scale)), mask);
+                __m128i cy = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(simd::clamp(y, -1.f, 1.f), scale)), mask);
+                __m128i cz = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(simd::clamp(z, -1.f, 1.f), scale)), mask);
+                __m128i cw = _mm_cvtps_epi32(simd::clamp(w, -1.f, 1.f));
+                __m128i packed = _mm_or_si128(cx, _mm_slli_epi32(cy, 10));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(cz, 20));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(cw, 30));
+                _mm_storeu_si128((__m128i*)(out + i), packed);
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = snorm10_10_10_2(Vector<4, float>(in[4 * i], in[4 * i + 1], in[4 * i + 2], in[4 * i + 3]));
+        }
+
+        inline void unpack(const snorm10_10_10_2 *in, float *out, int n) {
+            int i = 0;
+#ifdef ENG_MATH_SSE
+            const __m128 scale = _mm_set1_ps(1.f / 511.f), low = _mm_set1_ps(-1.f);
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+                __m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(v, 22), 22));
+                __m128 y = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(v, 12), 22));
+                __m128 z = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(v, 2), 22));
+                __m128 w = _mm_cvtepi32_ps(_mm_srai_epi32(v, 30));
+                x = _mm_max_ps(_mm_mul_ps(x, scale), low);
+                y = _mm_max_ps(_mm_mul_ps(y, scale), low);
+                z = _mm_max_ps(_mm_mul_ps(z, scale), low);
+                w = _mm_max_ps(w, low);
+                _MM_TRANSPOSE4_PS(x, y, z, w);
+                _mm_storeu_ps(out + 4 * i, x);
+                _mm_storeu_ps(out + 4 * i + 4, y);
+                _mm_storeu_ps(out + 4 * i + 8, z);
+                _mm_storeu_ps(out + 4 * i + 12, w);
+            }
+#endif
+            for (; i < n; i++) {
+                Vector<4, float> v = in[i];
+                for (int k = 0; k < 4; k++)
+                    out[4 * i + k] = v[k];
+            }
+        }
+
+    }
+
+
+    // Packs and unpacks whole arrays of vectors and matrices, e.g. Vec3f
+    // positions into Vec3h. Both sides are tightly packed, so this is one
+    // run over their elements. The 10_10_10_2 formats already hold a whole
+    // Vec4f each, they have their own overloads below.
+    template<typename S>
+    constexpr bool isPackedFormat() {
+        return std::is_same<S, unorm10_10_10_2>::value || std::is_same<S, snorm10_10_10_2>::value;
+    }
+
+    template<int D, typename S>
+    inline void pack(const Vector<D, float> *in, Vector<D, S> *out, int n) {
+        static_assert(!isPackedFormat<S>(), "10_10_10_2 formats pack whole Vec4f, not components");
+        static_assert(sizeof(Vector<D, S>) == D * sizeof(S), "Vector must be packed");
+        stream::pack((const float*)in, (S*)out, D * n);
+    }
+
+    template<int D, typename S>
+    inline void unpack(const Vector<D, S> *in, Vector<D, float> *out, int n) {
+        static_assert(!isPackedFormat<S>(), "10_10_10_2 formats unpack to whole Vec4f, not components");
+        static_assert(sizeof(Vector<D, S>) == D * sizeof(S), "Vector must be packed");
+        stream::unpack((const S*)in, (float*)out, D * n);
+    }
+
+    template<int D, typename S, typename L>
+    inline void pack(const Matrix<D, float, L> *in, Matrix<D, S, L> *out, int n) {
+        static_assert(!isPackedFormat<S>(), "10_10_10_2 formats pack whole Vec4f, not components");
+        static_assert(sizeof(Matrix<D, S, L>) == D * D * sizeof(S), "Matrix must be packed");
+        stream::pack((const float*)in, (S*)out, D * D * n);
+    }
+
+    template<int D, typename S, typename L>
+    inline void unpack(const Matrix<D, S, L> *in, Matrix<D, float, L> *out, int n) {
+        static_assert(!isPackedFormat<S>(), "10_10_10_2 formats unpack to whole Vec4f, not components");
+        static_assert(sizeof(Matrix<D, S, L>) == D * D * sizeof(S), "Matrix must be packed");
+        stream::unpack((const S*)in, (float*)out, D * D * n);
+    }
+
+    inline void pack(const Vector<4, float> *in, unorm10_10_10_2 *out, int n) {
+        stream::pack((const float*)in, out, n);
+    }
+
+    inline void unpack(const unorm10_10_10_2 *in, Vector<4, float> *out, int n) {
+        stream::unpack(in, (float*)out, n);
+    }
+
+    inline void pack(const Vector<4, float> *in, snorm10_10_10_2 *out, int n) {
+        stream::pack((const float*)in, out, n);
+    }
+
+    inline void unpack(const snorm10_10_10_2 *in, Vector<4, float> *out, int n) {
+        stream::unpack(in, (float*)out, n);
+    }
+
+
+    // Axis aligned bounding box.
+    template<typename T>
+    class AABB {
+
+    public:
+
+        Vector3<T> min, max;
+
+        constexpr AABB(const Vector<3, T> &min, const Vector<3, T> &max) : min(min), max(max) { }
+
+        constexpr AABB() { }
+
+        static constexpr AABB fromPoints(const Vector<3, T> *points, int count) {
+            AABB output(points[0], points[0]);
+            for (int i = 1; i < count; i++) {
+                for (int k = 0; k < 3; k++) {
+                    output.min[k] = points[i][k] < output.min[k] ? points[i][k] : output.min[k];
+                    output.max[k] = points[i][k] > output.max[k] ? points[i][k] : output.max[k];
+                }
+            }
+            return output;
+        }
+
+        constexpr Vector3<T> center() const {
+            return Vector3<T>((min[0] + max[0]) / 2, (min[1] + max[1]) / 2, (min[2] + max[2]) / 2);
+        }
+
+        // Half of the size along each axis.
+        constexpr Vector3<T> extent() const {
+            return Vector3<T>((max[0] - min[0]) / 2, (max[1] - min[1]) / 2, (max[2] - min[2]) / 2);
+        }
+
+        constexpr AABB merge(const AABB &b) const {
+            AABB output;
+            for (int k = 0; k < 3; k++) {
+                output.min[k] = b.min[k] < min[k] ? b.min[k] : min[k];
+                output.max[k] = b.max[k] > max[k] ? b.max[k] : max[k];
+            }
+            return output;
+        }
+
+        // Box around this one after the transform 'm'. The extent along
+        // each output axis is the sum of the absolute row elements times
+        // the input extents.
+        constexpr AABB transform(const Affine3x4<T> &m) const {
+            Vector3<T> c = center(), e = extent();
+            AABB output;
+            for (int row = 0; row < 3; row++) {
+                T middle = m[row][3], radius = 0;
+                for (int col = 0; col < 3; col++) {
+                    middle += m[row][col] * c[col];
+                    radius += (m[row][col] < 0 ? -m[row][col] : m[row][col]) * e[col];
+                }
+                output.min[row] = middle - radius;
+                output.max[row] = middle + radius;
+            }
+            return output;
+        }
+
+    };
+
+
+    template<typename T>
+    class Sphere {
+
+    public:
+
+        Vector3<T> center;
+        T radius;
+
+        constexpr Sphere(const Vector<3, T> &center, T radius) : center(center), radius(radius) { }
+
+        constexpr Sphere() : radius(0) { }
+
+        // The radius grows with the largest scale of 'm'.
+        inline Sphere transform(const Affine3x4<T> &m) const {
+            Sphere output;
+            T scale = 0;
+            for (int row = 0; row < 3; row++) {
+                output.center[row] = m[row][0] * center[0] + m[row][1] * center[1] + m[row][2] * center[2] + m[row][3];
+                T column = m[0][row] * m[0][row] + m[1][row] * m[1][row] + m[2][row] * m[2][row];
+                scale = column > scale ? column : scale;
+            }
+            output.radius = radius * sqrt(scale);
+            return output;
+        }
+
+    };
+
+
+    // The six planes bounding the clip volume of a projection, stored as
+    // (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside and the
+    // normal (a, b, c) of unit length.
+    template<typename T>
+    class Frustum {
+
+    public:
+
+        enum { Left, Right, Bottom, Top, Near, Far };
+
+        Vector<4, T> planes[6];
+
+        // Planes in the space 'm' maps from, e.g. world space for
+        // projection * view. Depth is clipped to [-w, w] as in GL, or to
+        // [0, w] as in Vulkan and D3D with 'zeroToOne'.
+        template<typename L>
+        explicit Frustum(const Matrix<4, T, L> &m, bool zeroToOne = false) {
+            for (int col = 0; col < 4; col++) {
+                planes[Left][col] = m(3, col) + m(0, col);
+                planes[Right][col] = m(3, col) - m(0, col);
+                planes[Bottom][col] = m(3, col) + m(1, col);
+                planes[Top][col] = m(3, col) - m(1, col);
+                planes[Near][col] = zeroToOne ? m(2, col) : m(3, col) + m(2, col);
+                planes[Far][col] = m(3, col) - m(2, col);
+            }
+            for (Vector<4, T> &p : planes) {
+                T scale = 1 / sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                p = p * scale;
+            }
+        }
+
+        Frustum() { }
+
+        constexpr T distance(int plane, const Vector<3, T> &p) const {
+            const Vector<4, T> &n = planes[plane];
+            return n[0] * p[0] + n[1] * p[1] + n[2] * p[2] + n[3];
+        }
+
+        // Conservative, a box that is outside of the frustum but not fully
+        // behind any one plane still counts as visible.
+        constexpr bool intersects(const AABB<T> &box) const {
+            Vector3<T> c = box.center(), e = box.extent();
+            for (int i = 0; i < 6; i++) {
+                const Vector<4, T> &n = planes[i];
+                T radius = (n[0] < 0 ? -n[0] : n[0]) * e[0]
+                         + (n[1] < 0 ? -n[1] : n[1]) * e[1]
+                         + (n[2] < 0 ? -n[2] : n[2]) * e[2];
+                if (distance(i, c) + radius < 0)
+                    return false;
+            }
+            return true;
+        }
+
+        constexpr bool intersects(const Sphere<T> &sphere) const {
+            for (int i = 0; i < 6; i++)
+                if (distance(i, sphere.center) + sphere.radius < 0)
+                    return false;
+            return true;
+        }
+
+    };
+
+
+    namespace stream {
+
+        // Frustum culling of structure of arrays bounds. Boxes are given by
+        // center and extent, spheres by center and radius. The indices of
+        // the visible ones are appended to 'visible' in order, starting at
+        // 'count', and the new count is returned. Every lane stores its
+        // index and only the visible ones advance the count, so there are
+        // no branches on the result and 'visible' needs room for all
+        // bounds.
+        template<typename P, typename T>
+        inline int cullBoxesRange(const Frustum<T> &frustum, const T *cx, const T *cy, const T *cz,
+                                  const T *ex, const T *ey, const T *ez, int *visible, int count,
+                                  int begin, int end) {
+            typename P::V n[6][4], a[6][3];
+            for (int i = 0; i < 6; i++) {
+                for (int k = 0; k < 4; k++)
+                    n[i][k] = P::set1(frustum.planes[i][k]);
+                for (int k = 0; k < 3; k++) {
+                    T c = frustum.planes[i][k];
+                    a[i][k] = P::set1(c < 0 ? -c : c);
+                }
+            }
+            for (int b = begin; b < end; b += P::lanes) {
+                typename P::V x = P::load(cx + b), y = P::load(cy + b), z = P::load(cz + b);
+                typename P::V sx = P::load(ex + b), sy = P::load(ey + b), sz = P::load(ez + b);
+                typename P::V d = P::set1(T(1));
+                for (int i = 0; i < 6; i++) {
+                    typename P::V center = P::add(P::add(P::mul(n[i][0], x), P::mul(n[i][1], y)),
+                                                  P::add(P::mul(n[i][2], z), n[i][3]));
+                    typename P::V radius = P::add(P::add(P::mul(a[i][0], sx), P::mul(a[i][1], sy)), P::mul(a[i][2], sz));
+                    d = P::min(d, P::add(center, radius));
+                }
+                int outside = P::negativeMask(d);
+                for (int k = 0; k < P::lanes; k++) {
+                    visible[count] = b + k;
+                    count += ((outside >> k) & 1) ^ 1;
+                }
+            }
+            return count;
+        }
+
+        template<typename P, typename T>
+        inline int cullSpheresRange(const Frustum<T> &frustum, const T *cx, const T *cy, const T *cz,
+                                    const T *radii, int *visible, int count, int begin, int end) {
+            typename P::V n[6][4];
+            for (int i = 0; i < 6; i++)
+                for (int k = 0; k < 4; k++)
+                    n[i][k] = P::set1(frustum.planes[i][k]);
+            for (int b = begin; b < end; b += P::lanes) {
+                typename P::V x = P::load(cx + b), y = P::load(cy + b), z = P::load(cz + b);
+                typename P::V r = P::load(radii + b);
+                typename P::V d = P::set1(T(1));
+                for (int i = 0; i < 6; i++) {
+                    typename P::V center = P::add(P::add(P::mul(n[i][0], x), P::mul(n[i][1], y)),
+                                                  P::add(P::mul(n[i][2], z), n[i][3]));
+                    d = P::min(d, P::add(center, r));
+                }
+                int outside = P::negativeMask(d);
+                for (int k = 0; k < P::lanes; k++) {
+                    visible[count] = b + k;
+                    count += ((outside >> k) & 1) ^ 1;
+                }
+            }
+            return count;
+        }
+
+        template<typename T>
+        inline int cullBoxes(const Frustum<T> &frustum, const T *cx, const T *cy, const T *cz,
+                             const T *ex, const T *ey, const T *ez, int *visible, int n) {
+            int count = cullBoxesRange<simd::Lanes<T>>(frustum, cx, cy, cz, ex, ey, ez, visible, 0, 0, bulkLength<T>(n));
+            return cullBoxesRange<simd::Scalar<T>>(frustum, cx, cy, cz, ex, ey, ez, visible, count, bulkLength<T>(n), n);
+        }
+
+        template<typename T>
+        inline int cullSpheres(const Frustum<T> &frustum, const T *cx, const T *cy, const T *cz,
+                               const T *radii, int *visible, int n) {
+            int count = cullSpheresRange<simd::Lanes<T>>(frustum, cx, cy, cz, radii, visible, 0, 0, bulkLength<T>(n));
+            return cullSpheresRange<simd::Scalar<T>>(frustum, cx, cy, cz, radii, visible, count, bulkLength<T>(n), n);
+        }
+
+    }
+
+
+    // Writes the indices of the boxes intersecting 'frustum' to 'visible'
+    // in ascending order and returns how many there are. 'visible' must
+    // have room for centers.size() indices.
+    template<typename T>
+    inline int cull(const Frustum<T> &frustum, const Vector3Array<T> &centers, const Vector3Array<T> &extents, int *visible) {
+        return stream::cullBoxes(frustum, centers.x(), centers.y(), centers.z(),
+                                 extents.x(), extents.y(), extents.z(), visible, centers.size());
+    }
+
+    // Same for spheres.
+    template<typename T>
+    inline int cull(const Frustum<T> &frustum, const Vector3Array<T> &centers, const T *radii, int *visible) {
+        return stream::cullSpheres(frustum, centers.x(), centers.y(), centers.z(), radii, visible, centers.size());
+    }
+
+
+    template<typename T>
+    class Ray {
+
+    public:
+
+        Vector3<T> origin, direction;
+
+        constexpr Ray(const Vector<3, T> &origin, const Vector<3, T> &direction) :
+            origin(origin), direction(direction) { }
+
+        constexpr Ray() { }
+
+        constexpr Vector3<T> at(T t) const {
+            return Vector3<T>(origin[0] + direction[0] * t, origin[1] + direction[1] * t, origin[2] + direction[2] * t);
+        }
+
+    };
+
+
+    // Moller-Trumbore. Returns whether 'ray' hits the triangle abc at a
+    // distance in [0, t), and if so sets t and the barycentrics u and v
+    // of b and c.
+    template<typename T>
+    constexpr bool intersectTriangle(
+        const Ray<T> &ray, const Vector<3, T> &a, const Vector<3, T> &b, const Vector<3, T> &c,
+        T &t, T &u, T &v
+    ) {
+        Vector3<T> e1(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+        Vector3<T> e2(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+        Vector3<T> p = ray.direction.cross(e2);
+        T det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (det == 0)
+            return false;
+        T inv = 1 / det;
+        Vector3<T> s(ray.origin[0] - a[0], ray.origin[1] - a[1], ray.origin[2] - a[2]);
+        T hitU = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+        if (hitU < 0 || hitU > 1)
+            return false;
+        Vector3<T> q = s.cross(e1);
+        T hitV = (ray.direction[0] * q[0] + ray.direction[1] * q[1] + ray.direction[2] * q[2]) * inv;
+        if (hitV < 0 || hitU + hitV > 1)
+            return false;
+        T hitT = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+        if (hitT < 0 || !(hitT < t))
+            return false;
+        t = hitT;
+        u = hitU;
+        v = hitV;
+        return true;
+    }
+
+
+    struct RayHit {
+        int primitive;
+        float t, u, v;
+    };
+
+
+    // Bounding volume hierarchy over boxes, for ray casts and overlap
+    // queries against meshes and scenes. Built top down with binned SAH,
+    // subtrees go to separate threads with ENG_MATH_THREADS. Nodes are 32
+    // bytes and stored depth first, the left child right after its
+    // parent.
+    class BVH {
+
+    public:
+
+        struct Node {
+            Vector3<float> min;
+            // Leaves: first entry in primitives(), others: the right child.
+            int32_t index;
+            Vector3<float> max;
+            // Leaves: number of primitives, others: -1 - split axis.
+            int32_t count;
+
+            inline bool leaf() const {
+                return count > 0;
+            }
+        };
+
+        static const int bins = 16;
+        static const int maxLeafSize = 16;
+        static const int maxDepth = 64;
+
+        // Subtrees with fewer primitives are built on the calling thread.
+        static const int parallelSize = 8192;
+
+    protected:
+
+        std::vector<Node> nodes_;
+        std::vector<int> primitives_;
+
+        struct Builder {
+            const AABB<float> *bounds;
+            std::vector<Vector3<float>> centroids;
+            int *primitives;
+
+            static float area(const Vector<3, float> &min, const Vector<3, float> &max) {
+                float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+                return x * y + y * z + z * x;
+            }
+
+            static void grow(Vector3<float> &min, Vector3<float> &max, const Vector<3, float> &lo, const Vector<3, float> &hi) {
+                for (int k = 0; k < 3; k++) {
+                    min[k] = lo[k] < min[k] ? lo[k] : min[k];
+                    max[k] = hi[k] > max[k] ? hi[k] : max[k];
+                }
+            }
+
+            // Appends the subtree over primitives [begin, end) to 'out' in
+            // depth first order, indices relative to the start of 'out'.
+            void build(int begin, int end, std::vector<Node> &out, int depth, int threads) {
+                const float inf = INFINITY;
+                Node node;
+                node.min = Vector3<float>(inf, inf, inf);
+                node.max = Vector3<float>(-inf, -inf, -inf);
+                Vector3<float> cMin(inf, inf, inf), cMax(-inf, -inf, -inf);
+                for (int i = begin; i < end; i++) {
+                    const AABB<float> &b = bounds[primitives[i]];
+                    grow(node.min, node.max, b.min, b.max);
+                    grow(cMin, cMax, centroids[primitives[i]], centroids[primitives[i]]);
+                }
+
+                int self = (int)out.size();
+                out.push_back(node);
+                int count = end - begin;
+                if (count == 1 || depth >= maxDepth) {
+                    out[self].index = begin;
+                    out[self].count = count;
+                    return;
+                }
+
+                // Cost of a split in units of primitive tests, traversing a
+                // node counts as one.
+                int bestAxis = -1, bestBin = 0;
+                float bestCost = INFINITY;
+                for (int axis = 0; axis < 3; axis++) {
+                    float extent = cMax[axis] - cMin[axis];
+                    if (!(extent > 0))
+                        continue;
+                    float scale = bins / extent;
+                    int binCount[bins] = { };
+                    Vector3<float> binMin[bins], binMax[bins];
+                    for (int b = 0; b < bins; b++) {
+                        binMin[b] = Vector3<float>(inf, inf, inf);
+                        binMax[b] = Vector3<float>(-inf, -inf, -inf);
+                    }
+                    for (int i = begin; i < end; i++) {
+                        int b = (int)((centroids[primitives[i]][axis] - cMin[axis]) * scale);
+                        b = b < bins - 1 ? b : bins - 1;
+                        binCount[b]++;
+                        grow(binMin[b], binMax[b], bounds[primitives[i]].min, bounds[primitives[i]].max);
+                    }
+
+                    // Right to left sweep for the right sides, then left to
+                    // right for the costs.
+                    float rightArea[bins];
+                    int rightCount[bins];
+                    Vector3<float> min(inf, inf, inf), max(-inf, -inf, -inf);
+                    int sum = 0;
+                    for (int b = bins - 1; b > 0; b--) {
+                        grow(min, max, binMin[b], binMax[b]);
+                        sum += binCount[b];
+                        rightCount[b] = sum;
+                        rightArea[b] = sum ? area(min, max) : 0;
+                    }
+                    min = Vector3<float>(inf, inf, inf);
+                    max = Vector3<float>(-inf, -inf, -inf);
+                    sum = 0;
+                    for (int b = 1; b < bins; b++) {
+                        grow(min, max, binMin[b - 1], binMax[b - 1]);
+                        sum += binCount[b - 1];
+                        if (!sum || !rightCount[b])
+                            continue;
+                        float cost = area(min, max) * sum + rightArea[b] * rightCount[b];
+                        if (cost < bestCost) {
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestBin = b;
+                        }
+                    }
+                }
+
+                float nodeArea = area(out[self].min, out[self].max);
+                bestCost = 1 + (nodeArea > 0 ? bestCost / nodeArea : 0);
+                int mid = begin;
+                if (bestAxis >= 0) {
+                    if (bestCost >= count && count <= maxLeafSize) {
+                        out[self].index = begin;
+                        out[self].count = count;
+                        return;
+                    }
+                    float scale = bins / (cMax[bestAxis] - cMin[bestAxis]);
+                    int hi = end;
+                    while (mid < hi) {
+                        int b = (int)((centroids[primitives[mid]][bestAxis] - cMin[bestAxis]) * scale);
+                        if ((b < bins - 1 ? b : bins - 1) < bestBin)
+                            mid++;
+                        else
+                            std::swap(primitives[mid], primitives[--hi]);
+                    }
+                } else {
+                    // Every centroid is in the same spot.
+                    if (count <= maxLeafSize) {
+                        out[self].index = begin;
+                        out[self].count = count;
+                        return;
+                    }
+                    bestAxis = 0;
+                    mid = begin + count / 2;
+                }
+                out[self].count = -1 - bestAxis;
+
+#ifdef ENG_MATH_THREADS
+                if (threads > 1 && count >= parallelSize) {
+                    std::vector<Node> right;
+                    std::thread worker([&]() { build(mid, end, right, depth + 1, threads / 2); });
+                    build(begin, mid, out, depth + 1, threads - threads / 2);
+                    worker.join();
+                    int offset = (int)out.size();
+                    out[self].index = offset;
+                    for (Node &n : right) {
+                        if (!n.leaf())
+                            n.index += offset;
+                        out.push_back(n);
+                    }
+                    return;
+                }
+#else
+                (void)threads;
+#endif
+                build(begin, mid, out, depth + 1, 1);
+                out[self].index = (int)out.size();
+                build(mid, end, out, depth + 1, 1);
+            }
+        };
+
+        // Casts rays [begin, end) in groups of P::lanes, testing the whole
+        // group against each node and descending while any of them hits.
+        // Children are visited in the order of the first ray's direction
+        // along the split axis, so coherent rays do best.
+        template<typename P, typename F>
+        void raycastRange(const Ray<float> *rays, float *tMax, int begin, int end, F &intersect) const {
+            typedef typename P::V V;
+            const int all = (1 << P::lanes) - 1;
+            int stack[maxDepth + 2];
+            for (int r = begin; r < end; r += P::lanes) {
+                float values[6][P::lanes];
+                for (int k = 0; k < P::lanes; k++) {
+                    for (int axis = 0; axis < 3; axis++) {
+                        float d = rays[r + k].direction[axis];
+                        // Keeps 0 * inf out of the slab test.
+                        d = d < 0 ? (d > -1e-30f ? -1e-30f : d) : (d < 1e-30f ? 1e-30f : d);
+                        values[axis][k] = rays[r + k].origin[axis];
+                        values[3 + axis][k] = 1 / d;
+                    }
+                }
+                V origin[3], inverse[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    origin[axis] = P::load(values[axis]);
+                    inverse[axis] = P::load(values[3 + axis]);
+                }
+                const Vector3<float> &lead = rays[r].direction;
+
+                int top = 0;
+                stack[top++] = 0;
+                while (top) {
+                    int current = stack[--top];
+                    const Node &node = nodes_[current];
+                    V tNear = P::set1(0), tFar = P::load(tMax + r);
+                    for (int axis = 0; axis < 3; axis++) {
+                        V t0 = P::mul(P::sub(P::set1(node.min[axis]), origin[axis]), inverse[axis]);
+                        V t1 = P::mul(P::sub(P::set1(node.max[axis]), origin[axis]), inverse[axis]);
+                        tNear = P::max(tNear, P::min(t0, t1));
+                        tFar = P::min(tFar, P::max(t0, t1));
+                    }
+                    int miss = P::negativeMask(P::sub(tFar, tNear));
+                    if (miss == all)
+                        continue;
+
+                    if (node.leaf()) {
+                        for (int k = 0; k < P::lanes; k++) {
+                            if ((miss >> k) & 1)
+                                continue;
+                            for (int i = node.index; i < node.index + node.count; i++)
+                                intersect(primitives_[i], r + k, tMax[r + k]);
+                        }
+                    } else if (lead[-1 - node.count] < 0) {
+                        stack[top++] = current + 1;
+                        stack[top++] = node.index;
+                    } else {
+                        stack[top++] = node.index;
+                        stack[top++] = current + 1;
+                    }
+                }
+            }
+        }
+
+        template<typename Test, typename F>
+        void overlapping(Test test, F &visit) const {
+            if (nodes_.empty())
+                return;
+            int stack[maxDepth + 2];
+            int top = 0;
+            stack[top++] = 0;
+            while (top) {
+                int current = stack[--top];
+                const Node &node = nodes_[current];
+                if (!test(node))
+                    continue;
+                if (node.leaf()) {
+                    for (int i = node.index; i < node.index + node.count; i++)
+                        visit(primitives_[i]);
+                } else {
+                    stack[top++] = node.index;
+                    stack[top++] = current + 1;
+                }
+            }
+        }
+
+    public:
+
+        BVH() { }
+
+        // Builds over 'count' boxes, primitive i being bounds[i]. With
+        // 'threads' <= 0 the thread count follows the size.
+        BVH(const AABB<float> *bounds, int count, int threads = 0) {
+            if (count <= 0)
+                return;
+            Builder builder;
+            builder.bounds = bounds;
+            builder.centroids.resize(count);
+            for (int i = 0; i < count; i++)
+                builder.centroids[i] = bounds[i].center();
+            primitives_.resize(count);
+            for (int i = 0; i < count; i++)
+                primitives_[i] = i;
+            builder.primitives = primitives_.data();
+
+#ifdef ENG_MATH_THREADS
+            if (threads <= 0)
+                threads = count < 2 * parallelSize ? 1 : (int)std::thread::hardware_concurrency();
+#endif
+            nodes_.reserve(2 * count - 1);
+            builder.build(0, count, nodes_, 0, threads);
+            nodes_.shrink_to_fit();
+        }
+
+        // Over indexed triangles, primitive i being the one at indices[3 * i].
+        static BVH fromTriangles(const Vector<3, float> *vertices, const uint32_t *indices, int triangles, int threads = 0) {
+            std::vector<AABB<float>> bounds(triangles);
+            for (int i = 0; i < triangles; i++) {
+                const Vector<3, float> *v[3] = {
+                    &vertices[indices[3 * i]], &vertices[indices[3 * i + 1]], &vertices[indices[3 * i + 2]]
+                };
+                for (int k = 0; k < 3; k++) {
+                    float lo = (*v[0])[k], hi = (*v[0])[k];
+                    for (int j = 1; j < 3; j++) {
+                        lo = (*v[j])[k] < lo ? (*v[j])[k] : lo;
+                        hi = (*v[j])[k] > hi ? (*v[j])[k] : hi;
+                    }
+                    bounds[i].min[k] = lo;
+                    bounds[i].max[k] = hi;
+                }
+            }
+            return BVH(bounds.data(), triangles, threads);
+        }
+
+
+        inline const Node* nodes() const { return nodes_.data(); }
+        inline int nodeCount() const { return (int)nodes_.size(); }
+        inline const int* primitives() const { return primitives_.data(); }
+        inline int size() const { return (int)primitives_.size(); }
+
+        inline AABB<float> bounds() const {
+            return nodes_.empty() ? AABB<float>() : AABB<float>(nodes_[0].min, nodes_[0].max);
+        }
+
+        // Calls visit(primitive) for the primitives in leaves that overlap
+        // 'box', a superset of the ones whose own bounds do.
+        template<typename F>
+        void query(const AABB<float> &box, F visit) const {
+            overlapping([&](const Node &node) {
+                return node.min[0] <= box.max[0] && node.max[0] >= box.min[0]
+                    && node.min[1] <= box.max[1] && node.max[1] >= box.min[1]
+                    && node.min[2] <= box.max[2] && node.max[2] >= box.min[2];
+            }, visit);
+        }
+
+        template<typename F>
+        void query(const Sphere<float> &sphere, F visit) const {
+            overlapping([&](const Node &node) {
+                float d = 0;
+                for (int k = 0; k < 3; k++) {
+                    float c = sphere.center[k];
+                    float e = c < node.min[k] ? node.min[k] - c : (c > node.max[k] ? c - node.max[k] : 0);
+                    d += e * e;
+                }
+                return d <= sphere.radius * sphere.radius;
+            }, visit);
+        }
+
+        // Calls intersect(primitive, ray, t) for primitives that 'rays'
+        // may hit closer than t = tMax[ray]. It should lower t on a hit,
+        // which prunes the rest of the traversal for that ray.
+        template<typename F>
+        void raycast(const Ray<float> *rays, int count, float *tMax, F intersect) const {
+            if (nodes_.empty())
+                return;
+            int bulk = count - count % simd::Lanes<float>::lanes;
+            raycastRange<simd::Lanes<float>>(rays, tMax, 0, bulk, intersect);
+            raycastRange<simd::Scalar<float>>(rays, tMax, bulk, count, intersect);
+        }
+
+        template<typename F>
+        void raycast(const Ray<float> &ray, float &tMax, F intersect) const {
+            if (!nodes_.empty())
+                raycastRange<simd::Scalar<float>>(&ray, &tMax, 0, 1, intersect);
+        }
+
+        // Closest hits against the triangles of fromTriangles(). hits[i].t
+        // is the maximum distance on input, hits[i].primitive is set to -1
+        // when nothing is hit.
+        void raycast(const Ray<float> *rays, int count, const Vector<3, float> *vertices, const uint32_t *indices,
+                     RayHit *hits) const {
+            std::vector<float> tMax(count);
+            for (int i = 0; i < count; i++) {
+                tMax[i] = hits[i].t;
+                hits[i].primitive = -1;
+            }
+            raycast(rays, count, tMax.data(), [&](int primitive, int ray, float &t) {
+                const uint32_t *index = indices + 3 * primitive;
+                RayHit &hit = hits[ray];
+                if (intersectTriangle(rays[ray], vertices[index[0]], vertices[index[1]], vertices[index[2]], t, hit.u, hit.v)) {
+                    hit.primitive = primitive;
+                    hit.t = t;
+                }
+            });
+        }
+
+        // Single rays skip the batch's tMax array, picking shouldn't allocate.
+        bool raycast(const Ray<float> &ray, const Vector<3, float> *vertices, const uint32_t *indices, RayHit &hit) const {
+            float tMax = hit.t;
+            hit.primitive = -1;
+            raycast(ray, tMax, [&](int primitive, int, float &t) {
+                const uint32_t *index = indices + 3 * primitive;
+                if (intersectTriangle(ray, vertices[index[0]], vertices[index[1]], vertices[index[2]], t, hit.u, hit.v)) {
+                    hit.primitive = primitive;
+                    hit.t = t;
+                }
+            });
+            return hit.primitive >= 0;
+        }
+
+    };
+
+
+    using Complex = ComplexNumber<double>;
+    using Quaternion = QuaternionNumber<double>;
+    using DualQuaternion = DualQuaternionNumber<double>;
+    using Complexf = ComplexNumber<float>;
+    using Quaternionf = QuaternionNumber<float>;
+    using DualQuaternionf = DualQuaternionNumber<float>;
+
+    using Vec2f = Vector<2, float>;
+    using Vec3f = Vector3<float>;
+    using Vec4f = Vector<4, float>;
+    using Vec2 = Vector<2, double>;
+    using Vec3 = Vector3<double>;
+    using Vec4 = Vector<4, double>;
+
+    using Mat2f = Matrix<2, float>;
+    using Mat3f = Matrix<3, float>;
+    using Mat4f = Matrix4x4<float>;
+    using Mat2 = Matrix<2, double>;
+    using Mat3 = Matrix<3, double>;
+    using Mat4 = Matrix4x4<double>;
+
+    using Affinef = Affine3x4<float>;
+    using Affine = Affine3x4<double>;
+
+    using Transformf = Transform<float>;
+
+    using Vec3fArray = Vector3Array<float>;
+    using Vec3Array = Vector3Array<double>;
+
+    using ComplexArrayf = ComplexArray<float>;
+    using FFTPlanf = FFTPlan<float>;
+
+    using AABBf = AABB<float>;
+    using Spheref = Sphere<float>;
+    using Frustumf = Frustum<float>;
+    using Rayf = Ray<float>;
+
+    using Vec2h = Vector<2, half>;
+    using Vec3h = Vector<3, half>;
+    using Vec4h = Vector<4, half>;
+    using Mat3h = Matrix<3, half>;
+    using Mat4h = Matrix<4, half>;
+    using Vec2sn16 = Vector<2, snorm16>;
+    using Vec3sn16 = Vector<3, snorm16>;
+    using Vec4sn16 = Vector<4, snorm16>;
+    using Vec4un8 = Vector<4, unorm8>;
+    using Vec4un10 = unorm10_10_10_2;
+    using Vec4sn10 = snorm10_10_10_2;
+
+
+    // These get memcpy'd straight into uniform and instance buffers, so
+    // they must stay tightly packed and trivially copyable.
+    static_assert(sizeof(Vec2f) == 8 && sizeof(Vec3f) == 12 && sizeof(Vec4f) == 16, "Vectors must be packed");
+    static_assert(sizeof(Mat3f) == 36 && sizeof(Mat4f) == 64, "Matrices must be packed");
+    static_assert(sizeof(Affinef) == 48 && sizeof(Quaternionf) == 16 && sizeof(DualQuaternionf) == 32,
+                  "Transforms must be packed");
+    static_assert(alignof(Vec4f) >= 16 && alignof(Mat4f) >= 16 && alignof(Affinef) >= 16 && alignof(Quaternionf) >= 16,
+                  "SIMD types must be 16-byte aligned");
+    static_assert(std::is_trivially_copyable<Vec4f>::value && std::is_trivially_copyable<Mat4f>::value &&
+                  std::is_trivially_copyable<Affinef>::value && std::is_trivially_copyable<DualQuaternionf>::value,
+                  "GPU types must be trivially copyable");
+    static_assert(sizeof(BVH::Node) == 32, "BVH nodes must be 32 bytes");
+    static_assert(sizeof(half) == 2 && sizeof(snorm16) == 2 && sizeof(unorm8) == 1 &&
+                  sizeof(unorm10_10_10_2) == 4 && sizeof(snorm10_10_10_2) == 4, "Compact types must be packed");
+    static_assert(sizeof(Vec3h) == 6 && sizeof(Vec4h) == 8 && sizeof(Mat4h) == 32 &&
+                  sizeof(Vec3sn16) == 6 && sizeof(Vec4un8) == 4 && sizeof(Vec4un10) == 4,
+                  "Compact vectors must be packed");
+    static_assert(std::is_trivially_copyable<Vec4h>::value && std::is_trivially_copyable<Vec4un8>::value &&
+                  std::is_trivially_copyable<snorm10_10_10_2>::value, "GPU types must be trivially copyable");
 
 }
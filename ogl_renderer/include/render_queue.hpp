@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+// Draws of a frame, ordered by a 64 bit key before submission. From the
+// top bit down the key holds the pass, the program, the material and the
+// depth, so sorted draws come grouped by pass, then by program and
+// material, and front to back within each group:
+//
+//   63   60 59      50 49        32 31      0
+//   | pass | program  | material   | depth   |
+//
+// Program and material are small ids the caller maps to GL objects.
+class RenderQueue {
+
+public:
+
+    struct Item {
+        uint64_t key;
+        // Whatever the caller needs to find the draw again.
+        int draw;
+    };
+
+    static constexpr int passBits = 4, programBits = 10, materialBits = 18, depthBits = 32;
+
+    static uint64_t key(unsigned pass, unsigned program, unsigned material, float depth) {
+        return (uint64_t)(pass & ((1u << passBits) - 1)) << 60
+             | (uint64_t)(program & ((1u << programBits) - 1)) << 50
+             | (uint64_t)(material & ((1u << materialBits) - 1)) << 32
+             | depthOrder(depth);
+    }
+
+    static unsigned pass(uint64_t key) { return (unsigned)(key >> 60); }
+    static unsigned program(uint64_t key) { return (unsigned)(key >> 50) & ((1u << programBits) - 1); }
+    static unsigned material(uint64_t key) { return (unsigned)(key >> 32) & ((1u << materialBits) - 1); }
+
+    // Float bits mapped so that unsigned order matches float order, for
+    // negative values too. Back to front passes use -depth.
+    static uint32_t depthOrder(float depth) {
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+    }
+
+    void clear() { items.clear(); }
+
+    void push(uint64_t key, int draw) { items.push_back({ key, draw }); }
+
+    // Stable LSD radix sort, a byte per pass. Bytes that are the same in
+    // every key, like the pass and program of a single pass frame, cost
+    // only their share of the histogram pass.
+    void sort();
+
+    int size() const { return (int)items.size(); }
+    const Item &operator[](int i) const { return items[i]; }
+    const Item *begin() const { return items.data(); }
+    const Item *end() const { return items.data() + items.size(); }
+
+protected:
+
+    std::vector<Item> items;
+    std::vector<Item> scratch;
+
+};
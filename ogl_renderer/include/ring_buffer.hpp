@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+
+// A persistently mapped buffer split into 'frames' regions, one per frame
+// in flight. Each frame bump allocates from its own region, which is
+// fenced at the end of the frame and only reused once the GPU is past
+// that fence. Writes go straight through the coherent mapping, so there
+// are no glBufferSubData copies and no implicit synchronization.
+class RingBuffer {
+
+public:
+
+    struct Allocation {
+        void *data;
+        // From the start of the buffer, for glBindBufferRange and offsets.
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    static const int maxFrames = 8;
+
+    // 'frames' outside of [1, maxFrames] is clamped, with an error.
+    RingBuffer(GLsizeiptr frameSize, int frames = 3);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer & operator=(const RingBuffer &) = delete;
+
+    // Moves to the next region, waiting for the GPU if it still reads it.
+    void beginFrame();
+
+    // Fences the commands that read the current region.
+    void endFrame();
+
+    // 'alignment' doesn't have to be a power of two, so offsets can be
+    // made multiples of an element size for base instances. Returns an
+    // allocation with null data when the region is full, callers have to
+    // check and drop what they wanted to draw with it.
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment);
+
+    template<typename T>
+    T *allocate(int count, GLsizeiptr alignment, GLintptr &offset) {
+        Allocation a = allocate(count * (GLsizeiptr)sizeof(T), alignment);
+        offset = a.offset;
+        return (T*)a.data;
+    }
+
+    GLuint buffer() const { return name; }
+    GLsizeiptr frameSize() const { return regionSize; }
+
+    // Frames that had to wait on their fence, a sign of too few regions.
+    int stalls() const { return stallCount; }
+
+    // Allocations that didn't fit, a sign of too small regions.
+    int overflows() const { return overflowCount; }
+
+    // Offset alignments the GL requires for uniform and storage ranges.
+    static GLsizeiptr uniformAlignment();
+    static GLsizeiptr storageAlignment();
+
+protected:
+
+    GLuint name;
+    unsigned char *mapped;
+    GLsizeiptr regionSize;
+    int regions;
+
+    int current;
+    GLsizeiptr head;
+    GLsync fences[maxFrames];
+    int stallCount;
+    int overflowCount;
+
+};
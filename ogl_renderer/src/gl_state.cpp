@@ -0,0 +1,95 @@
+#include "gl_state.hpp"
+
+#include <string.h>
+
+static const GLuint unknown = ~0u;
+
+void GLState::useProgram(GLuint program) {
+    if (changed(this->program != program)) {
+        glUseProgram(program);
+        this->program = program;
+    }
+}
+
+void GLState::bindVertexArray(GLuint vertexArray) {
+    if (changed(this->vertexArray != vertexArray)) {
+        glBindVertexArray(vertexArray);
+        this->vertexArray = vertexArray;
+        // The element array binding belongs to the vertex array.
+        buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+    }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    auto it = buffers.find(target);
+    if (changed(it == buffers.end() || it->second != buffer)) {
+        glBindBuffer(target, buffer);
+        buffers[target] = buffer;
+    }
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    uint64_t key = (uint64_t)target << 32 | index;
+    auto it = ranges.find(key);
+    if (changed(it == ranges.end() || it->second.buffer != buffer
+                || it->second.offset != offset || it->second.size != size)) {
+        glBindBufferRange(target, index, buffer, offset, size);
+        ranges[key] = { buffer, offset, size };
+        // Indexed binds also replace the generic binding of the target.
+        buffers[target] = buffer;
+    }
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (unit >= textures.size())
+        textures.resize(unit + 1, { 0, unknown });
+    Texture &bound = textures[unit];
+    if (!changed(bound.target != target || bound.texture != texture))
+        return;
+    if (activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    bound = { target, texture };
+}
+
+bool GLState::setUniform(GLint location, int count, const void *values) {
+    if (location < 0)
+        return false;
+    Uniform value = { count, { 0, 0, 0, 0 } };
+    memcpy(value.bits, values, count * sizeof(uint32_t));
+    uint64_t key = (uint64_t)program << 32 | (uint32_t)location;
+    auto it = uniforms.find(key);
+    // Compares bits, so -0.f and NaN count as changes too.
+    if (!changed(it == uniforms.end() || memcmp(&it->second, &value, sizeof(Uniform)) != 0))
+        return false;
+    uniforms[key] = value;
+    return true;
+}
+
+void GLState::uniform1i(GLint location, GLint value) {
+    if (setUniform(location, 1, &value))
+        glUniform1i(location, value);
+}
+
+void GLState::uniform1f(GLint location, GLfloat value) {
+    if (setUniform(location, 1, &value))
+        glUniform1f(location, value);
+}
+
+void GLState::uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat values[3] = { x, y, z };
+    if (setUniform(location, 3, values))
+        glUniform3f(location, x, y, z);
+}
+
+void GLState::invalidate() {
+    program = unknown;
+    vertexArray = unknown;
+    activeUnit = unknown;
+    buffers.clear();
+    ranges.clear();
+    textures.clear();
+    uniforms.clear();
+}
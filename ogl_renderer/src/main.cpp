@@ -4,11 +4,17 @@
 
 #include <iostream>
 #include <chrono>
+#include <numeric>
+#include <vector>
 
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 
 #include "math.hpp"
+#include "ring_buffer.hpp"
+#include "gl_state.hpp"
+#include "render_queue.hpp"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
@@ -16,17 +22,29 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 
 bool isCursorVisible = false;
 
+// One glDrawElementsInstanced for all cubes, or a draw call per cube.
+bool instanced = true;
+bool instancedKeyDown = false;
+
+// Culling in a compute shader and one glMultiDrawElementsIndirect, no
+// per-object work on the CPU besides animation. Takes over from the two
+// above while on.
+bool gpuCulling = false;
+bool gpuCullingKeyDown = false;
+
+const int cubeCount = 100000;
+const float cubeSpread = 10.f;
+
+// Only the first cubes spin, the others keep the matrices and bounds of
+// the first frame, so only a few transforms are dirty each frame.
+const int animatedCount = cubeCount / 16;
+
 float cameraRotX = 0.f;
 float cameraRotY = 0.f;
 float cameraPosX = 0.f;
 float cameraPosY = 0.f;
 float cameraPosZ = 5.f;
 
-struct Model {
-    eng::Vec3f position;
-    eng::Vec3f scale;
-};
-
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -58,6 +76,20 @@ void processInput(GLFWwindow *window) {
         cameraPosZ -= sinVel;
         cameraPosX -= cosVel;
     }
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
+        if (!instancedKeyDown)
+            instanced = !instanced;
+        instancedKeyDown = true;
+    } else {
+        instancedKeyDown = false;
+    }
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+        if (!gpuCullingKeyDown)
+            gpuCulling = !gpuCulling;
+        gpuCullingKeyDown = true;
+    } else {
+        gpuCullingKeyDown = false;
+    }
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
         cameraPosY += 0.2f;
     if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
@@ -85,7 +117,7 @@ void mouse_callback(GLFWwindow* window, double xPos, double yPos) {
 
 
 const char *vertexShaderSource = R"glsl(
-    #version 460 core
+    #version 450 core
 
     layout (location = 0) in vec3 aPos;
     layout (location = 1) in vec3 aNormal;
@@ -95,20 +127,69 @@ const char *vertexShaderSource = R"glsl(
     out vec3 Normal;
     out vec3 FragPos;
 
-    uniform mat4 posMat;
-    uniform mat4 modMat;
+    layout (std140, binding = 1) uniform Object {
+        mat4 posMat;
+        layout (row_major) mat4x3 modMat;
+        mat3 normMat;
+    };
 
     void main()
     {
         gl_Position = posMat * vec4(aPos, 1.0);
         TexCoord = aTexCoord;
-        FragPos = vec3(modMat * vec4(aPos, 1.0));
-        Normal = mat3(transpose(inverse(modMat))) * aNormal;
+        FragPos = modMat * vec4(aPos, 1.0);
+        Normal = normMat * aNormal;
+    }
+)glsl";
+
+// Same outputs as above, with the model matrix rows coming from the
+// instance buffer and the normal matrix computed here.
+const char *instancedVertexShaderSource = R"glsl(
+    #version 450 core
+
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec3 aNormal;
+    layout (location = 2) in vec2 aTexCoord;
+    layout (location = 3) in vec4 aModelRow0;
+    layout (location = 4) in vec4 aModelRow1;
+    layout (location = 5) in vec4 aModelRow2;
+
+    out vec2 TexCoord;
+    out vec3 Normal;
+    out vec3 FragPos;
+
+    struct Light {
+        vec3 position;
+
+        vec3 ambient;
+        vec3 diffuse;
+        vec3 specular;
+    };
+
+    layout (std140, binding = 0) uniform Frame {
+        mat4 projView;
+        vec3 viewPos;
+        Light light;
+    };
+
+    void main()
+    {
+        FragPos = vec4(aPos, 1.0) * mat3x4(aModelRow0, aModelRow1, aModelRow2);
+        gl_Position = projView * vec4(FragPos, 1.0);
+        TexCoord = aTexCoord;
+
+        // Cofactors, the inverse transpose up to the determinant. Only
+        // its sign matters, the fragment shader normalizes.
+        vec3 c0 = vec3(aModelRow0.x, aModelRow1.x, aModelRow2.x);
+        vec3 c1 = vec3(aModelRow0.y, aModelRow1.y, aModelRow2.y);
+        vec3 c2 = vec3(aModelRow0.z, aModelRow1.z, aModelRow2.z);
+        mat3 cofactor = mat3(cross(c1, c2), cross(c2, c0), cross(c0, c1));
+        Normal = cofactor * aNormal * sign(dot(c0, cofactor[0]));
     }
 )glsl";
 
 const char *fragmentShaderSource = R"glsl(
-    #version 460 core
+    #version 450 core
 
     struct Material {
         vec3 ambient;
@@ -136,10 +217,13 @@ const char *fragmentShaderSource = R"glsl(
     in vec3 Normal;
     in vec3 FragPos;
     
-    uniform vec3 viewPos;
+    layout (std140, binding = 0) uniform Frame {
+        mat4 projView;
+        vec3 viewPos;
+        Light light;
+    };
 
     uniform Material material;
-    uniform Light light;
     uniform Sun sun;
 
 
@@ -169,6 +253,65 @@ const char *fragmentShaderSource = R"glsl(
     }
 )glsl";
 
+// One invocation per object. Visible ones append their model matrix rows
+// to the instances and bump the instance count of the draw command, so the
+// instanced program above draws them with no CPU involvement.
+const char *cullComputeShaderSource = R"glsl(
+    #version 450 core
+
+    layout (local_size_x = 64) in;
+
+    struct Bounds {
+        vec4 center;
+        vec4 extent;
+    };
+
+    struct DrawCommand {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    layout (std140, binding = 2) uniform Cull {
+        vec4 planes[6];
+        uint objectCount;
+    };
+
+    layout (std430, binding = 0) readonly buffer LocalBounds { Bounds bounds[]; };
+    layout (std430, binding = 1) readonly buffer Transforms { vec4 transforms[]; };
+    layout (std430, binding = 2) writeonly buffer Instances { vec4 instances[]; };
+    layout (std430, binding = 3) buffer Commands { DrawCommand command; };
+
+    void main()
+    {
+        uint object = gl_GlobalInvocationID.x;
+        if (object >= objectCount)
+            return;
+
+        vec4 row0 = transforms[3 * object];
+        vec4 row1 = transforms[3 * object + 1];
+        vec4 row2 = transforms[3 * object + 2];
+
+        // World space box around the local one, as in AABB::transform.
+        vec4 c = vec4(bounds[object].center.xyz, 1.0);
+        vec3 e = bounds[object].extent.xyz;
+        vec3 center = vec3(dot(row0, c), dot(row1, c), dot(row2, c));
+        vec3 extent = vec3(dot(abs(row0.xyz), e), dot(abs(row1.xyz), e), dot(abs(row2.xyz), e));
+
+        // Same conservative test as Frustum::intersects.
+        for (int i = 0; i < 6; i++)
+            if (dot(planes[i].xyz, center) + planes[i].w + dot(abs(planes[i].xyz), extent) < 0.0)
+                return;
+
+        uint slot = atomicAdd(command.instanceCount, 1);
+        instances[3 * slot] = row0;
+        instances[3 * slot + 1] = row1;
+        instances[3 * slot + 2] = row2;
+    }
+)glsl";
+
 /*
 
         vec3 norm = normalize(Normal);
@@ -189,15 +332,138 @@ const char *fragmentShaderSource = R"glsl(
 
 */
 
+// std140 layouts of the Frame and Object blocks. Frame is written once
+// per frame, Object once per draw of the non-instanced path, both into the
+// ring buffer.
+struct FrameBlock {
+    eng::Mat4f projView;
+    eng::Vec4f viewPos;
+    eng::Vec4f lightPosition;
+    eng::Vec4f lightAmbient;
+    eng::Vec4f lightDiffuse;
+    eng::Vec4f lightSpecular;
+};
+
+struct ObjectBlock {
+    eng::Mat4f posMat;
+    eng::Affinef modMat;
+    eng::Vec4f normMat[3];
+};
+
+// std140 Cull block of the compute shader, written once per frame.
+struct CullBlock {
+    eng::Vec4f planes[6];
+    unsigned int objectCount;
+    unsigned int padding[3];
+};
+
+// Layout glMultiDrawElementsIndirect reads commands in.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Cube vertex as uploaded, 24 bytes instead of the 32 of the float table.
+// Normals are snorm16 with a zero w, texture coordinates half.
+struct Vertex {
+    eng::Vec3f position;
+    eng::Vec2h texCoord;
+    eng::Vec4sn16 normal;
+};
+
+static_assert(sizeof(Vertex) == 24, "Vertices must be packed");
+static_assert(!eng::Mat4f::GL_Transpose, "Blocks expect column major matrices");
+static_assert(sizeof(eng::Affinef) == 3 * sizeof(eng::Vec4f), "Instance rows are read as three vec4");
+static_assert(sizeof(FrameBlock) == 144 && sizeof(ObjectBlock) == 160 && sizeof(CullBlock) == 112,
+              "Blocks must match std140");
+
+// What a material id in a render queue key stands for.
+struct MaterialTextures {
+    unsigned int diffuse;
+    unsigned int specular;
+};
+
 float randf() {
     return (rand() % 10000) / 1000.f;
 }
 
+unsigned int createProgram(const char *vertexSource, const char *fragmentSource) {
+    unsigned int vertexShader;
+    vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(vertexShader);
+    int  success;
+    char infoLog[512];
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if(!success) {
+        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+
+    unsigned int fragmentShader;
+    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(fragmentShader);
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if(!success) {
+        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+
+    unsigned int shaderProgram;
+    shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if(!success) {
+        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    glDetachShader(shaderProgram, vertexShader);
+    glDeleteShader(vertexShader);
+    glDetachShader(shaderProgram, fragmentShader);
+    glDeleteShader(fragmentShader);
+
+    return shaderProgram;
+}
+
+unsigned int createComputeProgram(const char *source) {
+    unsigned int computeShader;
+    computeShader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShader, 1, &source, NULL);
+    glCompileShader(computeShader);
+    int  success;
+    char infoLog[512];
+    glGetShaderiv(computeShader, GL_COMPILE_STATUS, &success);
+    if(!success) {
+        glGetShaderInfoLog(computeShader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+
+    unsigned int program;
+    program = glCreateProgram();
+    glAttachShader(program, computeShader);
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success) {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    glDetachShader(program, computeShader);
+    glDeleteShader(computeShader);
+
+    return program;
+}
+
 int main() {
 
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   
@@ -270,6 +536,14 @@ int main() {
         -0.5f, 0.5f,-0.5f,  0.0f, 1.0f, 0.0f,  0.0f, 1.0f
     };
 
+    Vertex cubeVertices[36];
+    for (int i = 0; i < 36; i++) {
+        const float *v = vertices + 8 * i;
+        cubeVertices[i].position = eng::Vec3f(v[0], v[1], v[2]);
+        cubeVertices[i].texCoord = eng::Vec2h(eng::Vec2f(v[6], v[7]));
+        cubeVertices[i].normal = eng::Vec4sn16(eng::Vec4f(v[3], v[4], v[5], 0.f));
+    }
+
     unsigned int indices[36];
     for (int i = 0; i < 36; i++)
         indices[i] = i;
@@ -281,7 +555,7 @@ int main() {
     unsigned int VBO;
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
 
     unsigned int EBO;
     glGenBuffers(1, &EBO);
@@ -289,13 +563,13 @@ int main() {
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
     glEnableVertexAttribArray(0);
     // normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3* sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_SHORT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
     glEnableVertexAttribArray(1);
     // texture coords attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
     glEnableVertexAttribArray(2);
 
 
@@ -340,79 +614,122 @@ int main() {
 
 
 
-    unsigned int vertexShader;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-    int  success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if(!success) {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
+    unsigned int shaderProgram = createProgram(vertexShaderSource, fragmentShaderSource);
+    unsigned int instancedProgram = createProgram(instancedVertexShaderSource, fragmentShaderSource);
+    unsigned int cullProgram = createComputeProgram(cullComputeShaderSource);
 
-    unsigned int fragmentShader;
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if(!success) {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    unsigned int shaderProgram;
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if(!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
-    glUseProgram(shaderProgram);
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-
-    int positionMatrixLocation = glGetUniformLocation(shaderProgram, "posMat");
-    int modelMatrixLocation = glGetUniformLocation(shaderProgram, "modMat");
-    int viewPositionLocation = glGetUniformLocation(shaderProgram, "viewPos");
+    // From here on the binds, programs and uniforms go through the cache.
+    GLState state;
 
-    int lightAmbientLoc = glGetUniformLocation(shaderProgram, "light.ambient");
-    int lightSpecularLoc = glGetUniformLocation(shaderProgram, "light.specular");
-    int lightDiffuseLoc = glGetUniformLocation(shaderProgram, "light.diffuse");
-    int lightPositionLoc = glGetUniformLocation(shaderProgram, "light.position");
+    // Constant for the whole run, so both programs get them once.
+    for (unsigned int program : { shaderProgram, instancedProgram }) {
+        state.useProgram(program);
 
-    int matAmbientLoc = glGetUniformLocation(shaderProgram, "material.ambient");
-    // int matDiffuseLoc = glGetUniformLocation(shaderProgram, "material.diffuse");
-    // int matSpecularLoc = glGetUniformLocation(shaderProgram, "material.specular");
-    int matShininessLoc = glGetUniformLocation(shaderProgram, "material.shininess");
+        state.uniform3f(glGetUniformLocation(program, "material.ambient"), 0.2f, 0.3f, 0.3f);
+        // state.uniform3f(glGetUniformLocation(program, "material.diffuse"), 1.0f, 0.5f, 0.31f);
+        // state.uniform3f(glGetUniformLocation(program, "material.specular"), 0.5f, 0.5f, 0.5f);
+        state.uniform1f(glGetUniformLocation(program, "material.shininess"), 32.0f);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-    glUniform1i(glGetUniformLocation(shaderProgram, "diffuseMap"), 0);
-    glUniform1i(glGetUniformLocation(shaderProgram, "specularMap"), 1);
-
-    glBindVertexArray(VAO);
+        state.uniform1i(glGetUniformLocation(program, "diffuseMap"), 0);
+        state.uniform1i(glGetUniformLocation(program, "specularMap"), 1);
+    }
 
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-    eng::Vec3f light = { 1.0f, 1.0f, 1.0f };
-    eng::Vec3f lightPos = { 2.0f, 2.0f, 2.0f };
-
     glEnable(GL_DEPTH_TEST);
 
-    Model models[10];
-    for (int i = 0; i < 10; i++)
-        models[i] = { { randf(), randf(), randf() }, { 1.0f, 1.0f, 1.0f } };
+    std::vector<eng::Transformf> models(cubeCount);
+    for (int i = 0; i < cubeCount; i++)
+        models[i].setTranslation({ randf() * cubeSpread, randf() * cubeSpread, randf() * cubeSpread });
+
+    // Everything written per frame goes through the ring: the Frame block,
+    // then either the model matrix rows of the visible cubes or an Object
+    // block per draw. With GPU culling it's the model matrices of the
+    // animated cubes, the Cull block and the draw command, and the compute
+    // shader writes the visible rows back into the ring. A region fits the
+    // largest of these at full count.
+    GLsizeiptr uniformAlignment = RingBuffer::uniformAlignment();
+    GLsizeiptr storageAlignment = RingBuffer::storageAlignment();
+    // Visible rows are written as storage and read as instances, their
+    // offset has to suit both.
+    GLsizeiptr instanceAlignment = std::lcm(storageAlignment, (GLsizeiptr)sizeof(eng::Affinef));
+    if (instanceAlignment <= 0 || instanceAlignment % sizeof(eng::Affinef) != 0) {
+        std::cout << "ERROR::RING_BUFFER::BAD_INSTANCE_ALIGNMENT " << instanceAlignment << std::endl;
+        return -1;
+    }
+    GLsizeiptr objectStride = (sizeof(ObjectBlock) + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+    if (objectStride < (GLsizeiptr)sizeof(eng::Affinef))
+        objectStride = sizeof(eng::Affinef);
+    RingBuffer *ring = new RingBuffer(sizeof(FrameBlock) + uniformAlignment
+                                      + (cubeCount + 1) * objectStride);
+
+    // Instance attributes point at the start of the ring, the draw picks
+    // this frame's rows with its base instance.
+    state.bindVertexArray(VAO);
+    state.bindBuffer(GL_ARRAY_BUFFER, ring->buffer());
+    for (int row = 0; row < 3; row++) {
+        glVertexAttribPointer(3 + row, 4, GL_FLOAT, GL_FALSE, sizeof(eng::Affinef), (void*)(row * 4 * sizeof(float)));
+        glVertexAttribDivisor(3 + row, 1);
+        glEnableVertexAttribArray(3 + row);
+    }
+
+    // World space bounds of the cubes, culled against the camera frustum.
+    // Those of the animated cubes are refreshed every frame.
+    const eng::AABBf cubeBounds(eng::Vec3f(-0.5f, -0.5f, -0.5f), eng::Vec3f(0.5f, 0.5f, 0.5f));
+    eng::Vec3fArray boundsCenter(cubeCount), boundsExtent(cubeCount);
+    std::vector<int> visible(cubeCount);
+    auto updateBounds = [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            eng::AABBf bounds = cubeBounds.transform(eng::Affinef(models[i].getMatrix()));
+            boundsCenter.set(i, bounds.center());
+            boundsExtent.set(i, bounds.extent());
+        }
+    };
+    eng::Transformf::materializeDirty(models.data(), cubeCount);
+    updateBounds(0, cubeCount);
+
+    // Ids used in render queue keys.
+    const unsigned int programs[] = { shaderProgram, instancedProgram };
+    const MaterialTextures materials[] = { { texture1, texture2 } };
+    RenderQueue queue;
+
+    // Local bounds of every object for the compute shader, as center and
+    // extent. They don't change, unlike the transforms.
+    std::vector<eng::Vec4f> localBounds;
+    for (int i = 0; i < cubeCount; i++) {
+        eng::Vec3f center = cubeBounds.center(), extent = cubeBounds.extent();
+        localBounds.push_back(eng::Vec4f(center[0], center[1], center[2], 0.f));
+        localBounds.push_back(eng::Vec4f(extent[0], extent[1], extent[2], 0.f));
+    }
+    GLsizeiptr localBoundsSize = localBounds.size() * sizeof(eng::Vec4f);
+    unsigned int localBoundsBuffer;
+    glGenBuffers(1, &localBoundsBuffer);
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, localBoundsBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, localBoundsSize, localBounds.data(), 0);
+
+    // Model matrices of every object for the compute shader, uploaded
+    // once. Frames copy in those of the animated cubes from the ring, so
+    // the CPU cost doesn't grow with the static ones.
+    std::vector<eng::Affinef> transforms(cubeCount);
+    for (int i = 0; i < cubeCount; i++)
+        transforms[i] = eng::Affinef(models[i].getMatrix());
+    GLsizeiptr transformsSize = cubeCount * sizeof(eng::Affinef);
+    unsigned int transformBuffer;
+    glGenBuffers(1, &transformBuffer);
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, transformBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, transformsSize, transforms.data(), 0);
     
     int frames = 0;
+    GLState::Counters calls;
+    int rebuilt = 0;
+
+    // Every frame ends here, also those cut short by a full ring, so that
+    // the counters cover exactly one frame.
+    auto endFrame = [&]() {
+        ring->endFrame();
+        calls = state.endFrame();
+    };
     std::chrono::high_resolution_clock::time_point t1 = 
         std::chrono::high_resolution_clock::now();
 
@@ -426,7 +743,10 @@ int main() {
 
         if (dt > 1000000000) {
             t1 = t2;
-            std::cout << frames << '\n';
+            std::cout << frames << (gpuCulling ? " gpu culled" : instanced ? " instanced" : "") << ", "
+                      << ring->stalls() << " ring stalls, " << ring->overflows() << " overflows, "
+                      << calls.issued << " state calls issued, " << calls.skipped << " skipped, "
+                      << rebuilt << " matrices rebuilt\n";
             frames = 0;
         }
 
@@ -445,45 +765,157 @@ int main() {
 
         eng::Mat4f proj = eng::Mat4f::GL_Projection(90.f, wWidth, wHeight, 0.1, 100.f);
 
-        eng::Mat4f rot = eng::Matrix4x4<float>::yRotation(sin(timeValue));
+        eng::Quaternionf spin(sin(timeValue), eng::Vector<3, float>(0.f, 1.f, 0.f));
+        for (int i = 0; i < animatedCount; i++)
+            models[i].setRotation(spin);
+        rebuilt = eng::Transformf::materializeDirty(models.data(), cubeCount);
+
         eng::Mat4f view = eng::Mat4f::xRotation(cameraRotX)
             * eng::Mat4f::yRotation(cameraRotY)
             * eng::Mat4f::translation(-cameraPosX, -cameraPosY, -cameraPosZ);
-        for (int i = 0; i < 10; i++) {
-            eng::Vec3f p = models[i].position;
-            eng::Mat4f trans = eng::Mat4f::translation(p[0], p[1], p[2]);
-            eng::Mat4f model = trans * rot;
-            eng::Mat4f pos = proj * view * model;
-
-            glUniformMatrix4fv(positionMatrixLocation, 1, false, pos[0]);
-            glUniformMatrix4fv(modelMatrixLocation, 1, false, model[0]);
-            glUniform3f(viewPositionLocation, cameraPosX, cameraPosY, cameraPosZ);
-
-            glUniform3f(lightPositionLoc, lightPos[0], lightPos[1], lightPos[2]);
-            glUniform3f(lightAmbientLoc, 0.2f, 0.3f, 0.3f);
-            glUniform3f(lightSpecularLoc, 0.5f, 0.5f, 0.5f);
-            glUniform3f(lightDiffuseLoc, 1.0f, 1.0f, 1.0f);
-
-            glUniform3f(matAmbientLoc, 0.2f, 0.3f, 0.3f);
-            // glUniform3f(matDiffuseLoc, 1.0f, 0.5f, 0.31f);
-            // glUniform3f(matSpecularLoc, 0.5f, 0.5f, 0.5f);
-            glUniform1f(matShininessLoc, 32.0f);
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        eng::Mat4f projView = proj * view;
+
+        ring->beginFrame();
+
+        RingBuffer::Allocation frameRange = ring->allocate(sizeof(FrameBlock), uniformAlignment);
+        FrameBlock *frame = (FrameBlock*)frameRange.data;
+        if (!frame) {
+            // Nothing is drawn without the Frame block.
+            endFrame();
+            continue;
+        }
+        frame->projView = projView;
+        frame->viewPos = eng::Vec4f(cameraPosX, cameraPosY, cameraPosZ, 1.f);
+        frame->lightPosition = eng::Vec4f(2.0f, 2.0f, 2.0f, 1.f);
+        frame->lightAmbient = eng::Vec4f(0.2f, 0.3f, 0.3f, 0.f);
+        frame->lightDiffuse = eng::Vec4f(1.0f, 1.0f, 1.0f, 0.f);
+        frame->lightSpecular = eng::Vec4f(0.5f, 0.5f, 0.5f, 0.f);
+        state.bindBufferRange(GL_UNIFORM_BUFFER, 0, ring->buffer(), frameRange.offset, frameRange.size);
+
+        int visibleCount = 0;
+        queue.clear();
+        if (!gpuCulling) {
+            updateBounds(0, animatedCount);
+            visibleCount = eng::cull(eng::Frustumf(projView), boundsCenter, boundsExtent, visible.data());
+
+            // Opaque cubes front to back so that early depth testing
+            // rejects what's hidden, grouped by program and material.
+            unsigned int programId = instanced ? 1 : 0;
+            for (int v = 0; v < visibleCount; v++) {
+                int i = visible[v];
+                float dx = boundsCenter.x()[i] - cameraPosX;
+                float dy = boundsCenter.y()[i] - cameraPosY;
+                float dz = boundsCenter.z()[i] - cameraPosZ;
+                queue.push(RenderQueue::key(0, programId, 0, dx * dx + dy * dy + dz * dz), i);
+            }
+            queue.sort();
+        }
+
+        state.bindVertexArray(VAO);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        // Program and textures only change where the key above the depth
+        // does.
+        uint64_t group = ~0ull;
+        auto bindGroup = [&](uint64_t key) {
+            if (key >> RenderQueue::depthBits == group)
+                return;
+            group = key >> RenderQueue::depthBits;
+            const MaterialTextures &material = materials[RenderQueue::material(key)];
+            state.useProgram(programs[RenderQueue::program(key)]);
+            state.bindTexture(0, GL_TEXTURE_2D, material.diffuse);
+            state.bindTexture(1, GL_TEXTURE_2D, material.specular);
+        };
+
+        if (gpuCulling) {
+            RingBuffer::Allocation animatedRange = ring->allocate(animatedCount * sizeof(eng::Affinef),
+                                                                  alignof(eng::Affinef));
+            RingBuffer::Allocation instanceRange = ring->allocate(transformsSize, instanceAlignment);
+            RingBuffer::Allocation cullRange = ring->allocate(sizeof(CullBlock), uniformAlignment);
+            RingBuffer::Allocation commandRange = ring->allocate(sizeof(DrawElementsIndirectCommand), storageAlignment);
+            // The frame is skipped when any of it doesn't fit, the ring
+            // reports it.
+            if (!animatedRange.data || !instanceRange.data || !cullRange.data || !commandRange.data) {
+                endFrame();
+                continue;
+            }
+
+            // Copies run in order with the dispatches, the previous frame's
+            // still reads the old matrices.
+            eng::Affinef *animated = (eng::Affinef*)animatedRange.data;
+            for (int i = 0; i < animatedCount; i++)
+                animated[i] = eng::Affinef(models[i].getMatrix());
+            glCopyNamedBufferSubData(ring->buffer(), transformBuffer, animatedRange.offset, 0, animatedRange.size);
+
+            CullBlock *cull = (CullBlock*)cullRange.data;
+            eng::Frustumf frustum(projView);
+            for (int i = 0; i < 6; i++)
+                cull->planes[i] = frustum.planes[i];
+            cull->objectCount = cubeCount;
+
+            DrawElementsIndirectCommand *command = (DrawElementsIndirectCommand*)commandRange.data;
+            *command = { 36, 0, 0, 0, (GLuint)(instanceRange.offset / sizeof(eng::Affinef)) };
+
+            state.useProgram(cullProgram);
+            state.bindBufferRange(GL_UNIFORM_BUFFER, 2, ring->buffer(), cullRange.offset, cullRange.size);
+            state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, localBoundsBuffer, 0, localBoundsSize);
+            state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, transformBuffer, 0, transformsSize);
+            state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, ring->buffer(), instanceRange.offset, instanceRange.size);
+            state.bindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, ring->buffer(), commandRange.offset, commandRange.size);
+            glDispatchCompute((cubeCount + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+            // One command while all objects share the cube, a mesh per
+            // command would need no more than a longer command list.
+            bindGroup(RenderQueue::key(0, 1, 0, 0.f));
+            state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer());
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commandRange.offset, 1, 0);
+        } else if (instanced) {
+            // A single draw, sorted instances still come out front to back.
+            GLintptr offset;
+            eng::Affinef *instances = ring->allocate<eng::Affinef>(visibleCount, sizeof(eng::Affinef), offset);
+            if (instances && visibleCount > 0) {
+                for (int v = 0; v < visibleCount; v++)
+                    instances[v] = eng::Affinef(models[queue[v].draw].getMatrix());
+
+                bindGroup(queue[0].key);
+                glDrawElementsInstancedBaseInstance(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, visibleCount,
+                                                    offset / sizeof(eng::Affinef));
+            }
+        } else {
+            for (const RenderQueue::Item &item : queue) {
+                const eng::Mat4f &model = models[item.draw].getMatrix();
+                eng::Mat3f norm = model.normalMatrix();
+
+                RingBuffer::Allocation objectRange = ring->allocate(sizeof(ObjectBlock), uniformAlignment);
+                ObjectBlock *object = (ObjectBlock*)objectRange.data;
+                if (!object)
+                    break;
+                object->posMat = projView * model;
+                object->modMat = eng::Affinef(model);
+                for (int col = 0; col < 3; col++)
+                    object->normMat[col] = eng::Vec4f(norm(0, col), norm(1, col), norm(2, col), 0.f);
+
+                bindGroup(item.key);
+                state.bindBufferRange(GL_UNIFORM_BUFFER, 1, ring->buffer(), objectRange.offset, objectRange.size);
+                glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            }
         }
+
+        endFrame();
     }
 
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &localBoundsBuffer);
+    glDeleteBuffers(1, &transformBuffer);
+    delete ring;
     glDeleteVertexArrays(1, &VAO);
     glDeleteTextures(1, &texture1);
     glDeleteTextures(1, &texture2);
-    glDetachShader(shaderProgram, vertexShader);
-    glDeleteShader(vertexShader);
-    glDetachShader(shaderProgram, fragmentShader);
-    glDeleteShader(fragmentShader);
     glDeleteProgram(shaderProgram);
+    glDeleteProgram(instancedProgram);
+    glDeleteProgram(cullProgram);
 
     glfwTerminate();
 
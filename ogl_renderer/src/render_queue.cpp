@@ -0,0 +1,37 @@
+#include "render_queue.hpp"
+
+void RenderQueue::sort() {
+    size_t count = items.size();
+    if (count < 2)
+        return;
+
+    // All eight histograms in one read of the keys.
+    uint32_t histograms[8][256] = { };
+    for (const Item &item : items)
+        for (int b = 0; b < 8; b++)
+            histograms[b][(item.key >> (b * 8)) & 0xff]++;
+
+    scratch.resize(count);
+    Item *from = items.data();
+    Item *to = scratch.data();
+    for (int b = 0; b < 8; b++) {
+        uint32_t *histogram = histograms[b];
+        if (histogram[(from[0].key >> (b * 8)) & 0xff] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (int i = 0; i < 256; i++) {
+            uint32_t n = histogram[i];
+            histogram[i] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; i++)
+            to[histogram[(from[i].key >> (b * 8)) & 0xff]++] = from[i];
+
+        Item *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items.data())
+        items.swap(scratch);
+}
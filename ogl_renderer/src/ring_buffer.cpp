@@ -0,0 +1,78 @@
+#include "ring_buffer.hpp"
+
+#include <iostream>
+
+RingBuffer::RingBuffer(GLsizeiptr frameSize, int frames) :
+    regionSize(frameSize), regions(frames), current(0), head(0), stallCount(0), overflowCount(0) {
+    if (regions < 1 || regions > maxFrames) {
+        std::cout << "ERROR::RING_BUFFER::FRAME_COUNT_OUT_OF_RANGE\n";
+        regions = regions < 1 ? 1 : maxFrames;
+    }
+    for (GLsync &fence : fences)
+        fence = 0;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &name);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * regions, NULL, flags);
+    mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * regions, flags);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!mapped)
+        std::cout << "ERROR::RING_BUFFER::MAPPING_FAILED\n";
+}
+
+RingBuffer::~RingBuffer() {
+    for (GLsync fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &name);
+}
+
+void RingBuffer::beginFrame() {
+    current = (current + 1) % regions;
+    head = 0;
+
+    GLsync &fence = fences[current];
+    if (!fence)
+        return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        stallCount++;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+void RingBuffer::endFrame() {
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+RingBuffer::Allocation RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+    GLintptr start = current * regionSize;
+    GLintptr offset = (start + head + alignment - 1) / alignment * alignment;
+    if (!mapped || offset + size > start + regionSize) {
+        if (overflowCount++ == 0)
+            std::cout << "ERROR::RING_BUFFER::REGION_FULL\n";
+        return { nullptr, 0, 0 };
+    }
+    head = offset + size - start;
+    return { mapped + offset, offset, size };
+}
+
+GLsizeiptr RingBuffer::uniformAlignment() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return alignment;
+}
+
+GLsizeiptr RingBuffer::storageAlignment() {
+    GLint alignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return alignment;
+}